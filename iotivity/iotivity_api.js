@@ -51,6 +51,18 @@ function ERR(msg) {
 var g_next_async_call_id = 0;
 var g_async_calls = {};
 
+// 'json' until configure negotiates the binary 'cbor' envelope
+var g_wire_format = 'json';
+var CBOR_MESSAGE_PREFIX = 'cbor:';
+
+// streaming discoveries by asyncCallId: resources found so far and the
+// per call listener
+var g_discoveries = {};
+
+// commands issued in the same task go to native as one 'batch' message
+var g_batching = true;
+var g_pending_batch = null;
+
 function AsyncCall(resolve, reject) {
   this.resolve = resolve;
   this.reject = reject;
@@ -61,12 +73,247 @@ function createPromise(msg) {
     g_async_calls[g_next_async_call_id] = new AsyncCall(resolve, reject);
   });
   msg.asyncCallId = g_next_async_call_id;
-  extension.postMessage(JSON.stringify(msg));
+  queueMessage(msg);
   ++g_next_async_call_id;
 
   return promise;
 }
 
+// local queries answered synchronously by the native side, without a Promise
+function sendSyncMessage(msg) {
+  var reply = JSON.parse(
+      extension.internal.sendSyncMessage(JSON.stringify(msg)));
+
+  if ('error' in reply) {
+    DBG('sendSyncMessage: ' + msg.cmd + ' failed: ' + reply.error);
+    return null;
+  }
+
+  return reply.result;
+}
+
+function queueMessage(msg) {
+  if (!g_batching) {
+    extension.postMessage(encodeMessage(msg));
+    return;
+  }
+
+  if (g_pending_batch === null) {
+    g_pending_batch = [];
+    Promise.resolve().then(flushBatch);
+  }
+
+  g_pending_batch.push(msg);
+}
+
+// runs on the microtask boundary after the first queued command
+function flushBatch() {
+  var batch = g_pending_batch;
+  g_pending_batch = null;
+
+  if (batch.length == 1) {
+    extension.postMessage(encodeMessage(batch[0]));
+    return;
+  }
+
+  extension.postMessage(encodeMessage({
+    'cmd': 'batch',
+    'commands': batch
+  }));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Message encoding
+///////////////////////////////////////////////////////////////////////////////
+
+// The messaging bridge only carries strings, so a CBOR item travels base64
+// encoded behind CBOR_MESSAGE_PREFIX. JSON messages always start with '{'.
+function encodeMessage(msg) {
+  if (g_wire_format != 'cbor')
+    return JSON.stringify(msg);
+
+  var bytes = [];
+  cborEncode(msg, bytes);
+
+  var binary = '';
+  for (var i = 0; i < bytes.length; i += 0x2000) {
+    binary += String.fromCharCode.apply(null, bytes.slice(i, i + 0x2000));
+  }
+  return CBOR_MESSAGE_PREFIX + btoa(binary);
+}
+
+function decodeMessage(data) {
+  if (data.lastIndexOf(CBOR_MESSAGE_PREFIX, 0) != 0)
+    return JSON.parse(data);
+
+  var reader = {
+    bytes: atob(data.substring(CBOR_MESSAGE_PREFIX.length)),
+    pos: 0
+  };
+  return cborDecode(reader);
+}
+
+function cborWriteHead(major, arg, bytes) {
+  var type = major << 5;
+  if (arg < 24) {
+    bytes.push(type | arg);
+  } else if (arg <= 0xff) {
+    bytes.push(type | 24, arg);
+  } else if (arg <= 0xffff) {
+    bytes.push(type | 25, arg >> 8, arg & 0xff);
+  } else if (arg <= 0xffffffff) {
+    bytes.push(type | 26, (arg >>> 24) & 0xff, (arg >> 16) & 0xff,
+               (arg >> 8) & 0xff, arg & 0xff);
+  } else {
+    var high = Math.floor(arg / 0x100000000);
+    var low = arg % 0x100000000;
+    bytes.push(type | 27, (high >>> 24) & 0xff, (high >> 16) & 0xff,
+               (high >> 8) & 0xff, high & 0xff, (low >>> 24) & 0xff,
+               (low >> 16) & 0xff, (low >> 8) & 0xff, low & 0xff);
+  }
+}
+
+function cborWriteString(str, bytes) {
+  var utf8 = unescape(encodeURIComponent(str));
+  cborWriteHead(3, utf8.length, bytes);
+  for (var i = 0; i < utf8.length; i++)
+    bytes.push(utf8.charCodeAt(i));
+}
+
+function cborEncode(value, bytes) {
+  if (value === null || value === undefined ||
+      typeof value === 'function') {
+    bytes.push(0xf6);
+  } else if (typeof value === 'boolean') {
+    bytes.push(value ? 0xf5 : 0xf4);
+  } else if (typeof value === 'number') {
+    if (Math.floor(value) === value &&
+        Math.abs(value) <= Number.MAX_SAFE_INTEGER) {
+      if (value >= 0)
+        cborWriteHead(0, value, bytes);
+      else
+        cborWriteHead(1, -1 - value, bytes);
+    } else {
+      var view = new DataView(new ArrayBuffer(8));
+      view.setFloat64(0, value);
+      bytes.push(0xfb);
+      for (var i = 0; i < 8; i++)
+        bytes.push(view.getUint8(i));
+    }
+  } else if (typeof value === 'string') {
+    cborWriteString(value, bytes);
+  } else if (Array.isArray(value)) {
+    cborWriteHead(4, value.length, bytes);
+    value.forEach(function(item) { cborEncode(item, bytes); });
+  } else {
+    // same key filtering as JSON.stringify
+    var keys = Object.keys(value).filter(function(key) {
+      return value[key] !== undefined && typeof value[key] !== 'function';
+    });
+    cborWriteHead(5, keys.length, bytes);
+    keys.forEach(function(key) {
+      cborWriteString(key, bytes);
+      cborEncode(value[key], bytes);
+    });
+  }
+}
+
+function cborReadArg(info, reader) {
+  if (info < 24)
+    return info;
+
+  var length = {24: 1, 25: 2, 26: 4, 27: 8}[info];
+  if (!length)
+    throw new Error('Unsupported CBOR length');
+
+  var arg = 0;
+  for (var i = 0; i < length; i++)
+    arg = arg * 256 + reader.bytes.charCodeAt(reader.pos++);
+  return arg;
+}
+
+function cborReadFloat(info, reader) {
+  var length = {25: 2, 26: 4, 27: 8}[info];
+  var view = new DataView(new ArrayBuffer(length));
+  for (var i = 0; i < length; i++)
+    view.setUint8(i, reader.bytes.charCodeAt(reader.pos++));
+
+  if (length == 4)
+    return view.getFloat32(0);
+  if (length == 8)
+    return view.getFloat64(0);
+
+  var half = view.getUint16(0);
+  var exponent = (half >> 10) & 0x1f;
+  var mantissa = half & 0x3ff;
+  var number;
+  if (exponent == 0)
+    number = mantissa * Math.pow(2, -24);
+  else if (exponent != 31)
+    number = (mantissa + 1024) * Math.pow(2, exponent - 25);
+  else
+    number = mantissa ? NaN : Infinity;
+  return (half & 0x8000) ? -number : number;
+}
+
+function cborDecode(reader) {
+  var initial = reader.bytes.charCodeAt(reader.pos++);
+  var major = initial >> 5;
+  var info = initial & 0x1f;
+
+  if (major == 7) {
+    switch (info) {
+      case 20: return false;
+      case 21: return true;
+      case 22:
+      case 23: return null;
+      default: return cborReadFloat(info, reader);
+    }
+  }
+
+  // indefinite length array or map, closed by a 0xff break byte
+  if (info == 31 && (major == 4 || major == 5)) {
+    var items = major == 4 ? [] : {};
+    while (reader.bytes.charCodeAt(reader.pos) != 0xff) {
+      if (major == 4) {
+        items.push(cborDecode(reader));
+      } else {
+        var itemKey = cborDecode(reader);
+        items[itemKey] = cborDecode(reader);
+      }
+    }
+    reader.pos++;
+    return items;
+  }
+
+  var arg = cborReadArg(info, reader);
+  switch (major) {
+    case 0:
+      return arg;
+    case 1:
+      return -1 - arg;
+    case 2:
+    case 3:
+      var str = reader.bytes.substr(reader.pos, arg);
+      reader.pos += arg;
+      return major == 3 ? decodeURIComponent(escape(str)) : str;
+    case 4:
+      var array = [];
+      for (var i = 0; i < arg; i++)
+        array.push(cborDecode(reader));
+      return array;
+    case 5:
+      var object = {};
+      for (var j = 0; j < arg; j++) {
+        var key = cborDecode(reader);
+        object[key] = cborDecode(reader);
+      }
+      return object;
+    default:
+      return cborDecode(reader);  // tagged item
+  }
+}
+
 function _addConstProperty(obj, propertyKey, propertyValue) {
   Object.defineProperty(
       obj, propertyKey,
@@ -206,6 +453,32 @@ OicDevice.prototype.reboot = function() {
   return createPromise(msg);
 };
 
+// command queue counters, to size IOTIVITY_WORKERS and IOTIVITY_QUEUE_SIZE
+OicDevice.prototype.getExecutorStats = function() {
+  var msg = {
+    'cmd': 'getExecutorStats'
+  };
+  return createPromise(msg);
+};
+
+// same counters as getExecutorStats, without a round trip
+OicDevice.prototype.getStats = function() {
+  return sendSyncMessage({'cmd': 'getStats'});
+};
+
+// writes ~/oic_xwalk_stats.json and returns its path
+OicDevice.prototype.dumpStats = function() {
+  return sendSyncMessage({'cmd': 'dumpStats'});
+};
+
+OicDevice.prototype.dumpTrace = function() {
+  return sendSyncMessage({'cmd': 'dumpTrace'});
+};
+
+OicDevice.prototype.setTracing = function(enabled) {
+  return sendSyncMessage({'cmd': 'setTrace', 'enabled': !!enabled});
+};
+
 iotivity.OicDevice = OicDevice;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -219,11 +492,14 @@ function OicDeviceSettings(obj) {
     _addConstProperty(this, 'info', new OicDeviceInfo(obj.info));
     _addConstProperty(this, 'role', obj.role);
     _addConstProperty(this, 'connectionMode', obj.connectionMode);
+    // 'json' (default) or 'cbor' for the compact binary message envelope
+    _addConstProperty(this, 'wireFormat', obj.wireFormat || 'json');
   } else {
     _addConstProperty(this, 'url', '0.0.0.0:0');
     _addConstProperty(this, 'info', new OicDeviceInfo(null));
     _addConstProperty(this, 'role', 'intermediate');
     _addConstProperty(this, 'connectionMode', 'acked');
+    _addConstProperty(this, 'wireFormat', 'json');
   }
 }
 
@@ -267,17 +543,58 @@ iotivity.OicDeviceInfo = OicDeviceInfo;
 
 function OicClient(obj) {
   this.onresourcechange = null;
+  this.onresourcefound = null;
+  // called with the ids of the resources dropped to stay within
+  // IOTIVITY_RESOURCE_BUDGET, or restored ones their host no longer
+  // serves; rediscover them to use them again
+  this.onresourceevicted = null;
 }
 
 // client API: discovery
+// options.resourceType and options.interface take a string or an array,
+// resources match any of the given types and any of the given interfaces.
+// With options.diff the promise resolves with {generation, full, added,
+// changed, removed} relative to options.since, the generation of a previous
+// answer; unknown generations get every resource as added (full).
+// With options.onresourcefound or client.onresourcefound set, resources are
+// reported as they answer; the promise still resolves with all of them once
+// the discovery window closes.
+// With options.adaptive the window closes once responses stop coming
+// (options.quietFactor times their average spacing), bounded by
+// options.minWaitMs and options.maxWaitMs (default waitsec).
+// Results of a recent identical discovery are reused until presence reports
+// a change; options.maxAge (seconds) bounds their age, 0 always discovers.
+// Results are saved across restarts and checked again with each host.
+// options.host, or the last known endpoint of options.deviceId, is queried
+// by unicast; an unanswered unicast falls back to multicast.
 OicClient.prototype.findResources = function(options) {
+  var discoveryOptions = {};
+  var onfound = null;
+
+  for (var key in options) {
+    if (key == 'onresourcefound')
+      onfound = options[key];
+    else
+      discoveryOptions[key] = options[key];
+  }
+
+  if (onfound || this.onresourcefound) {
+    discoveryOptions.stream = true;
+    g_discoveries[g_next_async_call_id] = {
+      'resources': [],
+      'onresourcefound': onfound
+    };
+  }
+
   var msg = {
     'cmd': 'findResources',
-    'OicDiscoveryOptions': options
+    'OicDiscoveryOptions': discoveryOptions
   };
   return createPromise(msg);
 };
 
+// Recent results, including those saved before a restart, are reused the
+// same way as for findResources.
 OicClient.prototype.findDevices = function(options) {
   var msg = {
     'cmd': 'findDevices',
@@ -355,6 +672,27 @@ OicClient.prototype.cancelObserving = function(resourceId) {
   return createPromise(msg);
 };
 
+// properties of the last representation received for this resource, or
+// null if it is unknown
+OicClient.prototype.getCachedProperties = function(resourceId) {
+  return sendSyncMessage({
+    'cmd': 'getCachedRepresentation',
+    'id': resourceId
+  });
+};
+
+// ids of the discovered resources matching every given filter, each a
+// string or an array of them: deviceId, host, resourceType, interface
+OicClient.prototype.queryResources = function(filter) {
+  var msg = {'cmd': 'queryResources'};
+  filter = filter || {};
+  ['deviceId', 'host', 'resourceType', 'interface'].forEach(function(key) {
+    if (filter[key])
+      msg[key] = filter[key];
+  });
+  return sendSyncMessage(msg);
+};
+
 iotivity.OicClient = OicClient;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -411,6 +749,20 @@ OicServer.prototype.notify = function(resourceId, method,
   return createPromise(msg);
 };
 
+OicServer.prototype.getProperties = function(resourceId) {
+  return sendSyncMessage({
+    'cmd': 'getServerRepresentation',
+    'id': resourceId
+  });
+};
+
+OicServer.prototype.getObserverCount = function(resourceId) {
+  return sendSyncMessage({
+    'cmd': 'getObserverCount',
+    'id': resourceId
+  });
+};
+
 iotivity.OicServer = OicServer;
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -592,8 +944,20 @@ iotivity.QueryOption = QueryOption;
 //
 ///////////////////////////////////////////////////////////////////////////////
 extension.setMessageListener(function(json) {
-  var msg = JSON.parse(json);
+  var msg = decodeMessage(json);
   DBG('setMessageListener msg=' + JSON.stringify(msg));
+
+  // events posted close together by the native side arrive coalesced
+  if (msg.cmd == 'eventBatch') {
+    for (var i = 0; i < msg.events.length; i++)
+      handleMessage(msg.events[i]);
+    return;
+  }
+
+  handleMessage(msg);
+});
+
+function handleMessage(msg) {
   DBG('msg.cmd=' + msg.cmd);
 
   switch (msg.cmd) {
@@ -606,6 +970,9 @@ extension.setMessageListener(function(json) {
     case 'findDevicesCompleted':
       handleFoundDevices(msg);
       break;
+    case 'resourceFound':
+      handleResourceFound(msg);
+      break;
     case 'foundResourceCallback':
       handleFoundResources(msg);
       break;
@@ -628,6 +995,11 @@ extension.setMessageListener(function(json) {
       handleDeleteResourceCompleted(msg);
       break;
     case 'configureCompleted':
+      handleConfigureCompleted(msg);
+      break;
+    case 'getExecutorStatsCompleted':
+      handleGetExecutorStatsCompleted(msg);
+      break;
     case 'unregisterResourceCompleted':
     case 'enablePresenceCompleted':
     case 'disablePresenceCompleted':
@@ -636,6 +1008,9 @@ extension.setMessageListener(function(json) {
     case 'cancelObservingCompleted':
       handleAsyncCallSuccess(msg);
       break;
+    case 'resourcesEvicted':
+      handleResourcesEvicted(msg);
+      break;
     case 'asyncCallError':
       handleAsyncCallError(msg);
       break;
@@ -643,7 +1018,21 @@ extension.setMessageListener(function(json) {
       DBG('Received unknown command');
       break;
   }
-});
+}
+
+function handleConfigureCompleted(msg) {
+  if (msg.wireFormat)
+    g_wire_format = msg.wireFormat;
+
+  handleAsyncCallSuccess(msg);
+}
+
+function handleGetExecutorStatsCompleted(msg) {
+  if (msg.asyncCallId in g_async_calls) {
+    g_async_calls[msg.asyncCallId].resolve(msg.stats);
+    delete g_async_calls[msg.asyncCallId];
+  }
+}
 
 function handleRegisterResourceCompleted(msg) {
   DBG('handleRegisterResourceCompleted');
@@ -685,16 +1074,67 @@ function handleFoundDevices(msg) {
   }
 }
 
-function handleFoundResources(msg) {
-  DBG('handleFoundResources msg=' + JSON.stringify(msg));
+function handleResourceFound(msg) {
+  var oicResource = new OicResource(msg.resource.OicResourceInit);
+  _addConstProperty(oicResource, 'id', msg.resource.id);
+
+  var discovery = g_discoveries[msg.asyncCallId];
+  if (discovery) {
+    discovery.resources.push(oicResource);
+    if (discovery.onresourcefound)
+      discovery.onresourcefound(oicResource);
+  }
+
+  if (g_iotivity_device && g_iotivity_device.client &&
+      g_iotivity_device.client.onresourcefound) {
+    g_iotivity_device.client.onresourcefound(oicResource);
+  }
+}
 
+function handleResourcesEvicted(msg) {
+  if (g_iotivity_device && g_iotivity_device.client &&
+      g_iotivity_device.client.onresourceevicted) {
+    g_iotivity_device.client.onresourceevicted(msg.ids);
+  }
+}
+
+function createResourceList(resourcesArray) {
   var oicResourceList = [];
-  for (var i = 0; i < msg.resourcesArray.length; i++) {
-    var oicResourceObject = msg.resourcesArray[i];
+  for (var i = 0; i < resourcesArray.length; i++) {
+    var oicResourceObject = resourcesArray[i];
     var oicResource = new OicResource(oicResourceObject.OicResourceInit);
     _addConstProperty(oicResource, 'id', oicResourceObject.id);
     oicResourceList.push(oicResource);
   }
+  return oicResourceList;
+}
+
+function handleFoundResources(msg) {
+  DBG('handleFoundResources msg=' + JSON.stringify(msg));
+
+  if ('generation' in msg) {
+    if (msg.asyncCallId in g_async_calls) {
+      g_async_calls[msg.asyncCallId].resolve({
+        'generation': msg.generation,
+        'full': msg.full,
+        'added': createResourceList(msg.added),
+        'changed': createResourceList(msg.changed),
+        'removed': msg.removed
+      });
+    }
+    return;
+  }
+
+  var oicResourceList = [];
+  if (msg.streamed) {
+    // only marks the end of the discovery window
+    if (msg.asyncCallId in g_discoveries) {
+      oicResourceList = g_discoveries[msg.asyncCallId].resources;
+      delete g_discoveries[msg.asyncCallId];
+    }
+  } else {
+    oicResourceList = createResourceList(msg.resourcesArray);
+  }
 
   if (msg.asyncCallId in g_async_calls) {
     if (oicResourceList.length) {
@@ -820,6 +1260,7 @@ function handleAsyncCallError(msg) {
     g_async_calls[msg.asyncCallId].reject(Error('Async operation failed'));
     delete g_async_calls[msg.asyncCallId];
   }
+  delete g_discoveries[msg.asyncCallId];
 }
 
 exports.handleMessageAsync = function(msg, callback) {
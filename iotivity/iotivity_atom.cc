@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_atom.h"
+
+#include <mutex>
+#include <unordered_set>
+
+// Never destroyed, atoms may be used by static destructors. Set nodes do
+// not move on rehash, so atoms stay valid without the lock.
+static std::mutex& AtomLock() {
+  static std::mutex* lock = new std::mutex();
+  return *lock;
+}
+
+static std::unordered_set<std::string>& AtomTable() {
+  static std::unordered_set<std::string>* table =
+    new std::unordered_set<std::string>();
+  return *table;
+}
+
+static const std::string* EmptyAtom() {
+  static const std::string* empty = new std::string();
+  return empty;
+}
+
+static const std::string* Intern(const std::string& str) {
+  if (str.empty()) {
+    return EmptyAtom();
+  }
+
+  std::lock_guard<std::mutex> lock(AtomLock());
+  return &*AtomTable().insert(str).first;
+}
+
+IotivityAtom::IotivityAtom() : m_str(EmptyAtom()) {}
+
+IotivityAtom::IotivityAtom(const std::string& str) : m_str(Intern(str)) {}
+
+IotivityAtom::IotivityAtom(const char* str)
+  : m_str(Intern(std::string(str))) {}
+
+bool IotivityAtom::find(const std::string& str, IotivityAtom& atom) {
+  if (str.empty()) {
+    atom = IotivityAtom();
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(AtomLock());
+  auto it = AtomTable().find(str);
+
+  if (it == AtomTable().end()) {
+    return false;
+  }
+
+  atom = IotivityAtom(&*it);
+  return true;
+}
+
+size_t IotivityAtom::count() {
+  std::lock_guard<std::mutex> lock(AtomLock());
+  return AtomTable().size();
+}
+
+std::vector<IotivityAtom> ToAtoms(const std::vector<std::string>& strings) {
+  return std::vector<IotivityAtom>(strings.begin(), strings.end());
+}
+
+std::vector<std::string> ToStrings(const std::vector<IotivityAtom>& atoms) {
+  std::vector<std::string> strings;
+  strings.reserve(atoms.size());
+
+  for (auto const& atom : atoms) {
+    strings.push_back(atom.str());
+  }
+
+  return strings;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_ATOM_H_
+#define IOTIVITY_IOTIVITY_ATOM_H_
+
+#include <stddef.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Interned string, for the resource types and interfaces repeated across
+// resources.
+//
+// Atoms of equal strings share a single copy in a process wide table, so
+// they compare and hash as pointers. The table never shrinks: its content
+// is bounded by the vocabulary of the devices seen. Values that keep
+// changing, like hosts with their ephemeral ports, must not be interned.
+class IotivityAtom {
+ private:
+  const std::string* m_str;
+
+  explicit IotivityAtom(const std::string* str) : m_str(str) {}
+
+ public:
+  // The empty string
+  IotivityAtom();
+  IotivityAtom(const std::string& str);  // NOLINT(runtime/explicit)
+  IotivityAtom(const char* str);  // NOLINT(runtime/explicit)
+
+  // Atom of str if it was ever interned, without interning it
+  static bool find(const std::string& str, IotivityAtom& atom);
+  static size_t count();
+
+  const std::string& str() const { return *m_str; }
+  const char* c_str() const { return m_str->c_str(); }
+  bool empty() const { return m_str->empty(); }
+
+  bool operator==(const IotivityAtom& other) const {
+    return m_str == other.m_str;
+  }
+  bool operator!=(const IotivityAtom& other) const {
+    return m_str != other.m_str;
+  }
+  // String order, so sorted atoms list the same on every run
+  bool operator<(const IotivityAtom& other) const {
+    return m_str != other.m_str && *m_str < *other.m_str;
+  }
+
+  size_t hash() const { return std::hash<const void*>()(m_str); }
+};
+
+namespace std {
+template <>
+struct hash<IotivityAtom> {
+  size_t operator()(const IotivityAtom& atom) const { return atom.hash(); }
+};
+}  // namespace std
+
+std::vector<IotivityAtom> ToAtoms(const std::vector<std::string>& strings);
+std::vector<std::string> ToStrings(const std::vector<IotivityAtom>& atoms);
+
+#endif  // IOTIVITY_IOTIVITY_ATOM_H_
@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_cbor.h"
+
+#include <math.h>
+#include <string.h>
+
+const char kCborMessagePrefix[] = "cbor:";
+
+namespace {
+
+const size_t kCborPrefixLength = sizeof(kCborMessagePrefix) - 1;
+const unsigned kMaxDepth = 64;
+
+const char kBase64Chars[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+}  // namespace
+
+void CborWriteHead(std::string& out, uint8_t major, uint64_t arg) {
+  uint8_t type = major << 5;
+
+  if (arg < 24) {
+    out.push_back(static_cast<char>(type | arg));
+  } else if (arg <= 0xff) {
+    out.push_back(static_cast<char>(type | 24));
+    out.push_back(static_cast<char>(arg));
+  } else if (arg <= 0xffff) {
+    out.push_back(static_cast<char>(type | 25));
+    out.push_back(static_cast<char>(arg >> 8));
+    out.push_back(static_cast<char>(arg));
+  } else if (arg <= 0xffffffffULL) {
+    out.push_back(static_cast<char>(type | 26));
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(arg >> shift));
+    }
+  } else {
+    out.push_back(static_cast<char>(type | 27));
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(arg >> shift));
+    }
+  }
+}
+
+void CborWriteNumber(std::string& out, double number) {
+  // Integral values within the exact double range go out as CBOR ints
+  if (number == floor(number) && fabs(number) <= 9007199254740991.0) {
+    if (number >= 0) {
+      CborWriteHead(out, CBOR_UNSIGNED, static_cast<uint64_t>(number));
+    } else {
+      CborWriteHead(out, CBOR_NEGATIVE, static_cast<uint64_t>(-1 - number));
+    }
+    return;
+  }
+
+  uint64_t bits;
+  memcpy(&bits, &number, sizeof(bits));
+  out.push_back(static_cast<char>(0xfb));
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(bits >> shift));
+  }
+}
+
+bool CborReader::peek(uint8_t& major) {
+  while (m_pos < m_size && (m_data[m_pos] >> 5) == CBOR_TAG) {
+    uint64_t tag;
+    uint8_t info = m_data[m_pos++] & 0x1f;
+    if (!readArg(info, tag)) return false;
+  }
+
+  if (m_pos >= m_size) return false;
+
+  major = m_data[m_pos] >> 5;
+  return true;
+}
+
+bool CborReader::readLength(uint64_t& count, bool& indefinite) {
+  uint8_t major;
+  if (!peek(major) || (major != CBOR_ARRAY && major != CBOR_MAP)) {
+    return false;
+  }
+
+  uint8_t info = m_data[m_pos++] & 0x1f;
+  indefinite = info == 31;
+  count = 0;
+
+  if (indefinite) return true;
+
+  // Every item takes at least one byte
+  return readArg(info, count) && count <= m_size - m_pos;
+}
+
+bool CborReader::readBreak() {
+  if (m_pos < m_size && m_data[m_pos] == 0xff) {
+    m_pos++;
+    return true;
+  }
+  return false;
+}
+
+bool CborReader::readArg(uint8_t info, uint64_t& arg) {
+  if (info < 24) {
+    arg = info;
+    return true;
+  }
+
+  size_t length = 0;
+  if (info == 24) length = 1;
+  else if (info == 25) length = 2;
+  else if (info == 26) length = 4;
+  else if (info == 27) length = 8;
+  else return false;  // indefinite lengths are not produced by the JS side
+
+  if (m_size - m_pos < length) return false;
+
+  arg = 0;
+  for (size_t i = 0; i < length; i++) {
+    arg = (arg << 8) | m_data[m_pos++];
+  }
+  return true;
+}
+
+bool CborReader::readValue(picojson::value& value, unsigned depth) {
+  if (depth > kMaxDepth || m_pos >= m_size) return false;
+
+  uint8_t initial = m_data[m_pos++];
+  uint8_t major = initial >> 5;
+  uint8_t info = initial & 0x1f;
+
+  if (major == CBOR_SIMPLE) {
+    return readSimple(info, value);
+  }
+
+  if (info == 31 && (major == CBOR_ARRAY || major == CBOR_MAP)) {
+    return readIndefinite(major, value, depth);
+  }
+
+  uint64_t arg;
+  if (!readArg(info, arg)) return false;
+
+  switch (major) {
+    case CBOR_UNSIGNED:
+      value = picojson::value(static_cast<double>(arg));
+      return true;
+    case CBOR_NEGATIVE:
+      value = picojson::value(-1.0 - static_cast<double>(arg));
+      return true;
+    case CBOR_BYTES:
+    case CBOR_TEXT:
+      if (m_size - m_pos < arg) return false;
+      value = picojson::value(std::string(
+        reinterpret_cast<const char*>(m_data + m_pos), arg));
+      m_pos += arg;
+      return true;
+    case CBOR_ARRAY: {
+      if (arg > m_size - m_pos) return false;
+      value = picojson::value(picojson::array_type, false);
+      picojson::array& array = value.get<picojson::array>();
+      array.resize(arg);
+      for (uint64_t i = 0; i < arg; i++) {
+        if (!readValue(array[i], depth + 1)) return false;
+      }
+      return true;
+    }
+    case CBOR_MAP: {
+      if (arg > m_size - m_pos) return false;
+      value = picojson::value(picojson::object_type, false);
+      picojson::object& object = value.get<picojson::object>();
+      for (uint64_t i = 0; i < arg; i++) {
+        picojson::value key;
+        if (!readValue(key, depth + 1) || !key.is<std::string>()) {
+          return false;
+        }
+        if (!readValue(object[key.get<std::string>()], depth + 1)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case CBOR_TAG:
+      // Tags carry no meaning on this bridge, decode the tagged item
+      return readValue(value, depth + 1);
+  }
+
+  return false;
+}
+
+bool CborReader::readIndefinite(uint8_t major, picojson::value& value,
+                                unsigned depth) {
+  if (major == CBOR_ARRAY) {
+    value = picojson::value(picojson::array_type, false);
+    picojson::array& array = value.get<picojson::array>();
+    while (!readBreak()) {
+      array.push_back(picojson::value());
+      if (!readValue(array.back(), depth + 1)) return false;
+    }
+    return true;
+  }
+
+  value = picojson::value(picojson::object_type, false);
+  picojson::object& object = value.get<picojson::object>();
+  while (!readBreak()) {
+    picojson::value key;
+    if (!readValue(key, depth + 1) || !key.is<std::string>()) {
+      return false;
+    }
+    if (!readValue(object[key.get<std::string>()], depth + 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CborReader::readSimple(uint8_t info, picojson::value& value) {
+  if (info == 20 || info == 21) {
+    value = picojson::value(info == 21);
+    return true;
+  }
+
+  if (info == 22 || info == 23) {
+    value = picojson::value();
+    return true;
+  }
+
+  uint64_t bits;
+  if (info == 25) {
+    if (!readArg(info, bits)) return false;
+    // IEEE 754 half precision
+    int exponent = (bits >> 10) & 0x1f;
+    int mantissa = bits & 0x3ff;
+    double number;
+    if (exponent == 0) {
+      number = ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+      number = ldexp(mantissa + 1024, exponent - 25);
+    } else {
+      number = mantissa == 0 ? INFINITY : NAN;
+    }
+    value = picojson::value((bits & 0x8000) ? -number : number);
+    return true;
+  }
+
+  if (info == 26) {
+    if (!readArg(info, bits)) return false;
+    uint32_t bits32 = static_cast<uint32_t>(bits);
+    float number;
+    memcpy(&number, &bits32, sizeof(number));
+    value = picojson::value(static_cast<double>(number));
+    return true;
+  }
+
+  if (info == 27) {
+    if (!readArg(info, bits)) return false;
+    double number;
+    memcpy(&number, &bits, sizeof(number));
+    value = picojson::value(number);
+    return true;
+  }
+
+  return false;
+}
+
+namespace {
+
+int Base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+}  // namespace
+
+bool Base64Decode(const char* in, std::string& out) {
+  uint32_t n = 0;
+  int bits = 0;
+
+  for (; *in != '\0' && *in != '='; ++in) {
+    int v = Base64Value(*in);
+    if (v < 0) return false;
+    n = (n << 6) | v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back(static_cast<char>((n >> bits) & 0xff));
+    }
+  }
+
+  return true;
+}
+
+void Base64Encode(const std::string& in, std::string& out) {
+  size_t i = 0;
+  size_t size = in.size();
+  out.reserve(out.size() + ((size + 2) / 3) * 4);
+
+  for (; i + 2 < size; i += 3) {
+    uint32_t n = (static_cast<uint8_t>(in[i]) << 16) |
+                 (static_cast<uint8_t>(in[i + 1]) << 8) |
+                 static_cast<uint8_t>(in[i + 2]);
+    out.push_back(kBase64Chars[(n >> 18) & 0x3f]);
+    out.push_back(kBase64Chars[(n >> 12) & 0x3f]);
+    out.push_back(kBase64Chars[(n >> 6) & 0x3f]);
+    out.push_back(kBase64Chars[n & 0x3f]);
+  }
+
+  if (i < size) {
+    uint32_t n = static_cast<uint8_t>(in[i]) << 16;
+    if (i + 1 < size) n |= static_cast<uint8_t>(in[i + 1]) << 8;
+    out.push_back(kBase64Chars[(n >> 18) & 0x3f]);
+    out.push_back(kBase64Chars[(n >> 12) & 0x3f]);
+    out.push_back(i + 1 < size ? kBase64Chars[(n >> 6) & 0x3f] : '=');
+    out.push_back('=');
+  }
+}
+
+bool IsCborMessage(const char* msg) {
+  return strncmp(msg, kCborMessagePrefix, kCborPrefixLength) == 0;
+}
+
+void EncodeCbor(const picojson::value& value, std::string& out) {
+  if (value.is<picojson::null>()) {
+    out.push_back(static_cast<char>(0xf6));
+  } else if (value.is<bool>()) {
+    out.push_back(static_cast<char>(value.get<bool>() ? 0xf5 : 0xf4));
+  } else if (value.is<double>()) {
+    CborWriteNumber(out, value.get<double>());
+  } else if (value.is<std::string>()) {
+    const std::string& str = value.get<std::string>();
+    CborWriteHead(out, CBOR_TEXT, str.size());
+    out.append(str);
+  } else if (value.is<picojson::array>()) {
+    const picojson::array& array = value.get<picojson::array>();
+    CborWriteHead(out, CBOR_ARRAY, array.size());
+    for (picojson::array::const_iterator it = array.begin();
+         it != array.end(); ++it) {
+      EncodeCbor(*it, out);
+    }
+  } else if (value.is<picojson::object>()) {
+    const picojson::object& object = value.get<picojson::object>();
+    CborWriteHead(out, CBOR_MAP, object.size());
+    for (picojson::object::const_iterator it = object.begin();
+         it != object.end(); ++it) {
+      CborWriteHead(out, CBOR_TEXT, it->first.size());
+      out.append(it->first);
+      EncodeCbor(it->second, out);
+    }
+  }
+}
+
+bool DecodeCbor(const uint8_t* data, size_t size, picojson::value& value) {
+  CborReader reader(data, size);
+  return reader.readValue(value, 0) && reader.atEnd();
+}
+
+void EncodeCborMessage(const picojson::value& value, std::string& out) {
+  std::string cbor;
+  EncodeCbor(value, cbor);
+  out.assign(kCborMessagePrefix, kCborPrefixLength);
+  Base64Encode(cbor, out);
+}
+
+bool DecodeCborMessage(const char* msg, picojson::value& value) {
+  if (!IsCborMessage(msg)) return false;
+
+  std::string cbor;
+  if (!Base64Decode(msg + kCborPrefixLength, cbor)) return false;
+
+  return DecodeCbor(reinterpret_cast<const uint8_t*>(cbor.data()),
+                    cbor.size(), value);
+}
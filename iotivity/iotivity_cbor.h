@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_CBOR_H_
+#define IOTIVITY_IOTIVITY_CBOR_H_
+
+#include <stdint.h>
+#include <string>
+
+#include "common/picojson.h"
+
+// Compact binary envelope for the JS <-> native bridge.
+//
+// XW_MessagingInterface_1 only carries NUL terminated strings, so a CBOR
+// message travels as kCborMessagePrefix followed by the base64 encoded
+// CBOR item. JSON messages always start with '{' and never collide.
+extern const char kCborMessagePrefix[];
+
+enum {
+  CBOR_UNSIGNED = 0,
+  CBOR_NEGATIVE = 1,
+  CBOR_BYTES = 2,
+  CBOR_TEXT = 3,
+  CBOR_ARRAY = 4,
+  CBOR_MAP = 5,
+  CBOR_TAG = 6,
+  CBOR_SIMPLE = 7
+};
+
+// Pull reader over a CBOR item. Typed decoders walk arrays and maps with
+// peek() and readLength() and take scalars with readValue().
+class CborReader {
+ private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+
+  bool readIndefinite(uint8_t major, picojson::value& value, unsigned depth);
+  bool readSimple(uint8_t info, picojson::value& value);
+
+ public:
+  CborReader(const uint8_t* data, size_t size)
+    : m_data(data), m_size(size), m_pos(0) {}
+
+  bool atEnd() const { return m_pos == m_size; }
+  size_t position() const { return m_pos; }
+  void seek(size_t pos) { m_pos = pos; }
+
+  // Major type of the next item, tags are skipped
+  bool peek(uint8_t& major);
+  // Consumes an array or map head, |count| is unused when |indefinite|
+  bool readLength(uint64_t& count, bool& indefinite);
+  // Consumes the break byte that ends an indefinite length item
+  bool readBreak();
+  bool readArg(uint8_t info, uint64_t& arg);
+  bool readValue(picojson::value& value, unsigned depth);
+};
+
+bool IsCborMessage(const char* msg);
+void CborWriteHead(std::string& out, uint8_t major, uint64_t arg);
+void CborWriteNumber(std::string& out, double number);
+void Base64Encode(const std::string& in, std::string& out);
+bool Base64Decode(const char* in, std::string& out);
+void EncodeCbor(const picojson::value& value, std::string& out);
+bool DecodeCbor(const uint8_t* data, size_t size, picojson::value& value);
+void EncodeCborMessage(const picojson::value& value, std::string& out);
+bool DecodeCborMessage(const char* msg, picojson::value& value);
+
+#endif  // IOTIVITY_IOTIVITY_CBOR_H_
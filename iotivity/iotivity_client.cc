@@ -29,122 +29,1065 @@
  */
 #include <string>
 #include <map>
+#include <set>
 #include <algorithm>
+#include <limits>
+#include <vector>
 
 #include "iotivity/iotivity_client.h"
 #include "iotivity/iotivity_device.h"
+#include "iotivity/iotivity_discovery_store.h"
 #include "iotivity/iotivity_resource.h"
+#include "iotivity/iotivity_trace.h"
 
+// Found resources are posted as resourceFound events as they arrive,
+// instead of all at once when the discovery window closes
+static bool IsStreaming(const picojson::value& value) {
+  const picojson::value& param = value.get("OicDiscoveryOptions");
 
-IotivityClient::IotivityClient(IotivityDevice *device) : m_device(device) {
+  return param.is<picojson::object>() && param.contains("stream") &&
+         param.get("stream").evaluate_as_boolean();
+}
+
+// How long a completed discovery answers the same filters, unless
+// presence reports a change first
+static const size_t kDiscoveryTtlMs = 30000;
+// Saves are batched, the file only has to survive a restart
+static const unsigned kPersistDelayMs = 1000;
+// Resource memory budget in bytes, 0 keeps every resource
+static const size_t kResourceBudget = 16 * 1024 * 1024;
+// Devices not heard of for longer are discovered by multicast again
+static const double kHostTtlMs = 300000;
+
+// Options given as a single string or an array of them, sorted so equal
+// filters make equal cache keys
+static std::vector<std::string> GetStrings(const picojson::value& param,
+                                           const char* name) {
+  std::vector<std::string> values;
+
+  if (!param.is<picojson::object>() || !param.contains(name)) {
+    return values;
+  }
+
+  const picojson::value& option = param.get(name);
+  if (option.is<picojson::array>()) {
+    for (auto const &item : option.get<picojson::array>()) {
+      if (item.is<std::string>() && item.get<std::string>() != "") {
+        values.push_back(item.get<std::string>());
+      }
+    }
+  } else if (option.is<std::string>() && option.get<std::string>() != "") {
+    values.push_back(option.get<std::string>());
+  }
+
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+  return values;
+}
+
+static std::string Join(const std::vector<std::string>& values) {
+  std::string joined;
+
+  for (auto const &value : values) {
+    joined += (joined.empty() ? "" : ",") + value;
+  }
+
+  return joined;
+}
+
+// What a page sees of a discovered resource, changes make it rediscover
+static std::string Fingerprint(const IotivityResourceClientPtr& resClient) {
+  std::shared_ptr<OCResource> resource = resClient->getSharedPtr();
+
+  if (!resource) {
+    return "";
+  }
+
+  std::vector<std::string> types = resource->getResourceTypes();
+  std::vector<std::string> interfaces = resource->getResourceInterfaces();
+  std::sort(types.begin(), types.end());
+  std::sort(interfaces.begin(), interfaces.end());
+
+  return resource->host() + '\n' + resource->uri() + '\n' +
+         resClient->getDeviceId() + '\n' + Join(types) + '\n' +
+         Join(interfaces) + '\n' + (resource->isObservable() ? "o" : "");
+}
+
+static bool MatchesAny(const std::vector<std::string>& wanted,
+                       const std::vector<std::string>& offered) {
+  if (wanted.empty()) {
+    return true;
+  }
+
+  for (auto const &value : offered) {
+    if (std::binary_search(wanted.begin(), wanted.end(), value)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+IotivityClient::IotivityClient(IotivityDevice *device)
+  : m_device(device),
+    m_resourceIndex(GetEnvSize("IOTIVITY_RESOURCE_BUDGET", kResourceBudget)),
+    m_evictPending(false),
+    m_discoveryCache(GetEnvSize("IOTIVITY_DISCOVERY_TTL_MS", kDiscoveryTtlMs)),
+    m_presenceHandle(NULL), m_lastGeneration(0), m_persistPending(false) {
 }
 
 IotivityClient::~IotivityClient() {
-  for (auto const &entity : m_resourcemap) {
-    IotivityResourceClient *resClient = entity.second;
-    delete resClient;
+  if (m_presenceHandle != NULL) {
+    OCPlatform::unsubscribePresence(m_presenceHandle);
+  }
+
+  std::set<IotivityTimerWheel::TimerId> timers;
+  {
+    std::lock_guard<std::mutex> lock(m_timerLock);
+    timers.swap(m_timers);
+  }
+
+  // Returns once a reply already running has finished
+  for (auto const &timer : timers) {
+    m_device->getTimers()->cancel(timer);
+  }
+
+  if (m_persistPending) {
+    persistDiscoveries();
   }
-  m_resourcemap.clear();
-  m_foundresourcemap.clear();
+
+  {
+    std::lock_guard<std::mutex> lock(m_discoveryLock);
+    for (auto const &discovery : m_discoveries) {
+      std::lock_guard<std::mutex> contextLock(discovery.second->lock);
+      discovery.second->closed = true;
+      discovery.second->resources.clear();
+    }
+    m_discoveries.clear();
+  }
+
+  m_resourceIndex.clear();
 }
 
-void IotivityClient::foundResourceCallback(std::shared_ptr<OCResource> resource,
-    const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "\n###foundResourceCallback:\n");
-  picojson::value param = value.get("OicDiscoveryOptions");
-  std::string deviceId = "";
+void IotivityClient::registerHandlers(IotivityDispatcher* dispatcher,
+                                      IotivityDevice* device) {
+  typedef void (IotivityClient::*ClientHandler)(const picojson::value&);
+  static const struct {
+    uint32_t id;
+    ClientHandler handler;
+  } kHandlers[] = {
+    {CommandHash("findResources"), &IotivityClient::handleFindResources},
+    {CommandHash("findDevices"), &IotivityClient::handleFindDevices},
+    {CommandHash("retrieveResource"), &IotivityClient::handleRetrieveResource},
+    {CommandHash("deleteResource"), &IotivityClient::handleDeleteResource},
+    {CommandHash("startObserving"), &IotivityClient::handleStartObserving},
+    {CommandHash("cancelObserving"), &IotivityClient::handleCancelObserving},
+  };
 
-  if (param.contains("deviceId")) {
-    deviceId = param.get("deviceId").to_str();
+  for (auto const &entry : kHandlers) {
+    ClientHandler handler = entry.handler;
+    dispatcher->registerHandler(entry.id,
+      [device, handler](const picojson::value& value) {
+        IotivityClient *client = device->getClient();
+        if (client == NULL) {
+          device->postError("client role not configured",
+                            GetAsyncCallId(value));
+          return;
+        }
+        (client->*handler)(value);
+      });
   }
 
-  IotivityResourceClient *resClient = new IotivityResourceClient(m_device);
+  dispatcher->registerPropertiesHandler(CommandHash("updateResource"),
+    "OicResource",
+    [device](const picojson::value& value, OCRepresentation* properties) {
+      IotivityClient *client = device->getClient();
+      if (client == NULL) {
+        device->postError("client role not configured", GetAsyncCallId(value));
+        return;
+      }
+      client->handleUpdateResource(value, properties);
+    });
+
+  dispatcher->registerPropertiesHandler(CommandHash("createResource"),
+    "OicResourceInit",
+    [device](const picojson::value& value, OCRepresentation* properties) {
+      IotivityClient *client = device->getClient();
+      if (client == NULL) {
+        device->postError("client role not configured", GetAsyncCallId(value));
+        return;
+      }
+      client->handleCreateResource(value, properties);
+    });
+}
+
+void IotivityClient::foundResourceCallback(std::shared_ptr<OCResource> resource,
+    const DiscoveryContextPtr& context) {
+  OIC_LOG_V(DEBUG, TAG, "\n###foundResourceCallback:\n");
+
+  IotivityResourceClientPtr resClient =
+    std::make_shared<IotivityResourceClient>(m_device);
   resClient->setSharedPtr(resource);
-  PrintfOcResource((const OCResource &)*resource);
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_RESOURCE_FOUND,
+                 resource->getResourceTypes().size(),
+                 resource->getResourceInterfaces().size());
+  rememberHost(resource->sid(), resource->host());
+
+  // The stack query carries at most one type or interface, the rest of
+  // the filter is applied here
+  if ((context->deviceId == "" || resource->sid() == context->deviceId) &&
+      MatchesAny(context->resourceTypes, resource->getResourceTypes()) &&
+      MatchesAny(context->interfaces, resource->getResourceInterfaces())) {
+    std::unique_lock<std::mutex> lock(context->lock);
+
+    // Answers after the reply, or for every interface or endpoint of a
+    // resource already found
+    if (context->closed ||
+        context->resources.count(resClient->getResourceId())) {
+      return;
+    }
 
-  if (deviceId == "" || resource->sid() == deviceId) {
-    m_foundresourcemap[resClient->getResourceId()] = resClient;
-    // No collisions between sid and resource
-    m_foundresourcemap[resource->sid()] = resClient;
-  }
+    // Streamed resources are indexed right away, a known one is reused
+    if (context->streaming) {
+      std::lock_guard<std::mutex> resourceLock(m_resourceLock);
+      resClient = m_resourceIndex.insert(resClient);
+      if (m_resourceIndex.overBudget()) {
+        scheduleEviction();
+      }
+    }
 
-  int waitsec = GetWait(value);
+    context->resources[resClient->getResourceId()] = resClient;
+    lock.unlock();
+
+    if (context->streaming) {
+      postResourceFound(resClient, context->asyncCallId);
+    }
+  }
 
-  if (waitsec == -1) {
-    findPreparedRequest(value);
+  if (context->waitsec == -1) {
+    findPreparedRequest(context, 0);
+  } else {
+    discoveryResponse(context);
   }
 }
 
-void IotivityClient::findDevicePreparedRequest(const picojson::value& value) {
+void IotivityClient::findDevicePreparedRequest(
+  const DiscoveryContextPtr& context, double windowMs) {
   OIC_LOG_V(DEBUG, TAG, "findDevicePreparedRequest\n");
 
-  std::lock_guard<std::mutex> lock(m_callbackLockDevices);
+  std::vector<std::string> ids;
+  {
+    std::lock_guard<std::mutex> lock(context->lock);
+    ids.assign(context->devices.begin(), context->devices.end());
+  }
+
   picojson::value::object object;
   object["cmd"] = picojson::value("findDevicesCompleted");
 
-  double async_call_id = value.get("asyncCallId").get<double>();
-  object["asyncCallId"] = picojson::value(async_call_id);
+  object["asyncCallId"] = picojson::value(context->asyncCallId);
   picojson::array devicesArray;
 
-  for (auto const &entity : m_founddevicemap) {
-    IotivityDeviceInfo *deviceInfo = entity.second;
-    picojson::object deviceobj;
-    picojson::object properties;
-    deviceInfo->serialize(properties);
-    deviceobj["info"] = picojson::value(properties);
-    devicesArray.push_back(picojson::value(deviceobj));
-    m_devicemap[entity.first] = deviceInfo;
+  {
+    std::lock_guard<std::mutex> lock(m_callbackLockDevices);
+    for (auto const &id : ids) {
+      auto it = m_devicemap.find(id);
+      if (it == m_devicemap.end()) {
+        continue;
+      }
+
+      picojson::object deviceobj;
+      picojson::object properties;
+      it->second->serialize(properties);
+      deviceobj["info"] = picojson::value(properties);
+      devicesArray.push_back(picojson::value(deviceobj));
+    }
   }
 
   object["devicesArray"] = picojson::value(devicesArray);
-  m_device->PostMessage(picojson::value(object).serialize().c_str());
+  object["window"] = picojson::value(windowMs);
+  object["cached"] = picojson::value(context->cached);
+
+  if (context->closed && !context->cached && context->cacheKey != "") {
+    m_discoveryCache.store(context->cacheKey, context->host, ids,
+                           context->cacheGeneration);
+    schedulePersist();
+  }
+
+  m_device->PostMessage(picojson::value(object));
 }
 
-void IotivityClient::findDeviceTimerCallback(const picojson::value& value) {
-  int waitsec = GetWait(value);
+void IotivityClient::scheduleTimer(
+  unsigned delayMs, const IotivityTimerWheel::Callback& callback) {
+  IotivityTimerWheel* timers = m_device->getTimers();
+  std::shared_ptr<IotivityTimerWheel::TimerId> timer =
+    std::make_shared<IotivityTimerWheel::TimerId>(0);
+
+  // The callback waits for the id to be recorded before forgetting it
+  std::lock_guard<std::mutex> lock(m_timerLock);
+  *timer = timers->schedule(delayMs, [this, timer, callback]() {
+    {
+      std::lock_guard<std::mutex> lock(m_timerLock);
+      m_timers.erase(*timer);
+    }
+    callback();
+  });
+  m_timers.insert(*timer);
+}
+
+static double GetOption(const picojson::value& param, const char* name,
+                        double defaultValue) {
+  if (param.is<picojson::object>() && param.contains(name) &&
+      param.get(name).is<double>()) {
+    return param.get(name).get<double>();
+  }
 
-  sleep(waitsec);
-  findDevicePreparedRequest(value);
+  return defaultValue;
 }
 
-void IotivityClient::findPreparedRequest(const picojson::value &value) {
-  std::lock_guard<std::mutex> lock(m_callbackLock);
-  picojson::value::object object;
-  object["cmd"] = picojson::value("foundResourceCallback");
+// Reads a non-negative option clamped to limit, fails when it is present
+// but not a number or negative
+static bool GetBoundedOption(const picojson::value& param, const char* name,
+                             double defaultValue, double limit,
+                             double& value) {
+  value = defaultValue;
+  if (param.is<picojson::object>() && param.contains(name)) {
+    const picojson::value& option = param.get(name);
+    if (!option.is<double>() || !(option.get<double>() >= 0)) {
+      return false;
+    }
+    value = option.get<double>();
+  }
 
-  double async_call_id = value.get("asyncCallId").get<double>();
-  object["asyncCallId"] = picojson::value(async_call_id);
-  picojson::array resourcesArray;
+  value = std::max(0.0, std::min(value, limit));
+  return true;
+}
 
-  for (auto const &entity : m_foundresourcemap) {
-    IotivityResourceClient *resClient = entity.second;
-    picojson::object resourceobj;
-    resClient->serialize(resourceobj);
-    picojson::value v = picojson::value(resourceobj);
+static double ElapsedMs(std::chrono::steady_clock::time_point from,
+                        std::chrono::steady_clock::time_point to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
 
-    // no duplicates
-    if (std::find(resourcesArray.begin(),
-                  resourcesArray.end(), v) == resourcesArray.end()) {
-      resourcesArray.push_back(v);
+// Default bounds of adaptive discovery windows and the weight of the
+// latest gap in the running average
+static const double kMinWindowMs = 200;
+static const double kQuietFactor = 3;
+static const double kGapWeight = 0.3;
+static const double kMaxWindowMs = 600000;
+static const double kMaxQuietFactor = 100;
+
+IotivityClient::DiscoveryContextPtr IotivityClient::newDiscovery(
+  const picojson::value& value, ReplyHandler reply) {
+  const picojson::value& param = value.get("OicDiscoveryOptions");
+  DiscoveryContextPtr context = std::make_shared<DiscoveryContext>();
+
+  context->request = value;
+  context->asyncCallId = GetAsyncCallId(value);
+  if (param.is<picojson::object>() && param.contains("deviceId")) {
+    context->deviceId = param.get("deviceId").to_str();
+  }
+  context->resourceTypes = GetStrings(param, "resourceType");
+  context->interfaces = GetStrings(param, "interface");
+  context->streaming = IsStreaming(value);
+  context->diff = param.is<picojson::object>() && param.contains("diff") &&
+                  param.get("diff").evaluate_as_boolean();
+  context->since = GetOption(param, "since", 0);
+  context->waitsec = GetWait(value);
+  context->reply = reply;
+  context->closed = false;
+  context->cacheGeneration = 0;
+  context->cached = false;
+
+  context->start = std::chrono::steady_clock::now();
+  context->last = context->start;
+  context->gapMs = 0;
+  context->responses = 0;
+  context->adaptive = param.is<picojson::object>() &&
+                      param.contains("adaptive") &&
+                      param.get("adaptive").evaluate_as_boolean();
+  if (!GetBoundedOption(param, "maxWaitMs", context->waitsec * 1000.0,
+                        kMaxWindowMs, context->maxMs) ||
+      !GetBoundedOption(param, "minWaitMs", kMinWindowMs,
+                        kMaxWindowMs, context->minMs) ||
+      !GetBoundedOption(param, "quietFactor", kQuietFactor,
+                        kMaxQuietFactor, context->quietFactor)) {
+    return DiscoveryContextPtr();
+  }
+  context->minMs = std::min(context->minMs, context->maxMs);
+  return context;
+}
+
+void IotivityClient::openDiscoveryWindow(const DiscoveryContextPtr& context) {
+  {
+    std::lock_guard<std::mutex> lock(m_discoveryLock);
+    m_discoveries[context->asyncCallId] = context;
+  }
+
+  double firstCheckMs = context->adaptive ? context->minMs : context->maxMs;
+  scheduleTimer(static_cast<unsigned>(firstCheckMs),
+                [this, context]() { checkDiscoveryWindow(context); });
+}
+
+void IotivityClient::discoveryResponse(const DiscoveryContextPtr& context) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(context->lock);
+  double gapMs = ElapsedMs(context->last, now);
+
+  // The first gap is the round trip of the fastest responder
+  context->gapMs = context->responses ?
+    (1 - kGapWeight) * context->gapMs + kGapWeight * gapMs : gapMs;
+  context->last = now;
+  context->responses++;
+}
+
+// Timers only ever check the deadline, responses just move it further
+void IotivityClient::checkDiscoveryWindow(const DiscoveryContextPtr& context) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::unique_lock<std::mutex> lock(context->lock);
+
+  if (context->closed) {
+    return;
+  }
+
+  double elapsedMs = ElapsedMs(context->start, now);
+  double deadlineMs = context->maxMs;
+
+  // Without any response, wait for the slowest allowed responder
+  if (context->adaptive && context->responses) {
+    deadlineMs = ElapsedMs(context->start, context->last) +
+                 context->quietFactor * context->gapMs;
+    deadlineMs = std::max(deadlineMs, context->minMs);
+    deadlineMs = std::min(deadlineMs, context->maxMs);
+  }
+
+  if (elapsedMs < deadlineMs) {
+    lock.unlock();
+    scheduleTimer(static_cast<unsigned>(deadlineMs - elapsedMs + 1),
+                  [this, context]() { checkDiscoveryWindow(context); });
+    return;
+  }
+
+  context->closed = true;
+  lock.unlock();
+
+  {
+    std::lock_guard<std::mutex> discoveryLock(m_discoveryLock);
+    auto it = m_discoveries.find(context->asyncCallId);
+    if (it != m_discoveries.end() && it->second == context) {
+      m_discoveries.erase(it);
     }
-    m_resourcemap[entity.first] = entity.second;
   }
 
-  object["resourcesArray"] = picojson::value(resourcesArray);
-  m_device->PostMessage(picojson::value(object).serialize().c_str());
+  OIC_LOG_V(DEBUG, TAG, "discovery window closed after %dms\n",
+    static_cast<int>(elapsedMs));
+  (this->*context->reply)(context, elapsedMs);
 }
 
-void IotivityClient::findResourceTimerCallback(const picojson::value &value) {
-  int waitsec = GetWait(value);
+void IotivityClient::postResourceFound(
+  const IotivityResourceClientPtr& resClient, double async_call_id) {
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("resourceFound");
+  writer.key("asyncCallId");
+  writer.value(async_call_id);
+  writer.key("resource");
+  resClient->serializeObject(writer);
+  writer.endObject();
+  m_device->PostMessage(writer);
+}
+
+void IotivityClient::subscribePresence() {
+  std::lock_guard<std::mutex> lock(m_presenceLock);
+
+  if (m_presenceHandle != NULL) {
+    return;
+  }
+
+  SubscribeCallback presenceHandler =
+    std::bind(&IotivityClient::presenceCallback, this, std::placeholders::_1,
+              std::placeholders::_2, std::placeholders::_3);
+  OCStackResult result = OCPlatform::subscribePresence(m_presenceHandle,
+                         OC_MULTICAST_IP, CT_DEFAULT, presenceHandler);
+
+  // The cache still expires after its TTL, try again on next discovery
+  if (OC_STACK_OK != result) {
+    OIC_LOG_V(ERROR, TAG, "subscribePresence failed %d\n", result);
+    m_presenceHandle = NULL;
+  }
+}
+
+void IotivityClient::presenceCallback(OCStackResult result,
+                                      const unsigned int nonce,
+                                      const std::string& host) {
+  {
+    std::lock_guard<std::mutex> lock(m_presenceLock);
+    auto it = m_presenceNonces.find(host);
+
+    // Servers announce the same nonce until their resources change
+    if (OC_STACK_OK == result) {
+      if (it != m_presenceNonces.end() && it->second == nonce) {
+        return;
+      }
+      m_presenceNonces[host] = nonce;
+    } else if (it != m_presenceNonces.end()) {
+      m_presenceNonces.erase(it);
+    }
+  }
+
+  if (OC_STACK_OK != result) {
+    forgetHost(host);
+  }
+
+  OIC_LOG_V(DEBUG, TAG, "presence of %s changed (%d), nonce=%u\n",
+            host.c_str(), result, nonce);
+  m_discoveryCache.invalidateHost(host);
+}
+
+bool IotivityClient::findCachedResources(const DiscoveryContextPtr& context,
+                                         double maxAgeMs) {
+  std::vector<std::string> ids;
+
+  if (!m_discoveryCache.lookup(context->cacheKey, maxAgeMs, ids)) {
+    return false;
+  }
+
+  for (auto const &id : ids) {
+    IotivityResourceClientPtr resClient = getResourceById(id);
+
+    // Gone from the registry since, discover again
+    if (resClient == NULL) {
+      context->resources.clear();
+      return false;
+    }
+    context->resources[resClient->getResourceId()] = resClient;
+  }
+
+  if (context->streaming) {
+    for (auto const &entity : context->resources) {
+      postResourceFound(entity.second, context->asyncCallId);
+    }
+  }
+
+  context->cached = true;
+  context->closed = true;
+  findPreparedRequest(context, 0);
+  return true;
+}
+
+bool IotivityClient::findCachedDevices(const DiscoveryContextPtr& context,
+                                       double maxAgeMs) {
+  std::vector<std::string> ids;
+
+  if (!m_discoveryCache.lookup(context->cacheKey, maxAgeMs, ids)) {
+    return false;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_callbackLockDevices);
+    for (auto const &id : ids) {
+      if (m_devicemap.count(id) == 0) {
+        return false;
+      }
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(context->lock);
+    context->devices.insert(ids.begin(), ids.end());
+  }
+
+  context->cached = true;
+  context->closed = true;
+  findDevicePreparedRequest(context, 0);
+  return true;
+}
+
+void IotivityClient::rememberHost(const std::string& deviceId,
+                                  const std::string& host) {
+  if (deviceId == "" || host == "") {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(m_hostLock);
+  KnownHost& known = m_hosts[deviceId];
+  known.host = host;
+  known.seen = std::chrono::steady_clock::now();
+}
+
+// Empty when the device is unknown or not heard of for kHostTtlMs
+std::string IotivityClient::knownHost(const std::string& deviceId) {
+  std::lock_guard<std::mutex> lock(m_hostLock);
+  auto it = m_hosts.find(deviceId);
+
+  if (it == m_hosts.end()) {
+    return "";
+  }
+
+  if (ElapsedMs(it->second.seen, std::chrono::steady_clock::now()) >=
+      kHostTtlMs) {
+    m_hosts.erase(it);
+    return "";
+  }
+
+  return it->second.host;
+}
+
+void IotivityClient::forgetHost(const std::string& host) {
+  std::lock_guard<std::mutex> lock(m_hostLock);
+
+  for (auto it = m_hosts.begin(); it != m_hosts.end();) {
+    if (it->second.host == host) {
+      it = m_hosts.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// A device found in the host table may have moved since: without any
+// answer the same request is made again by multicast
+void IotivityClient::findUnicastRequest(const DiscoveryContextPtr& context,
+                                        double windowMs) {
+  bool answered;
+  {
+    std::lock_guard<std::mutex> lock(context->lock);
+    answered = !context->resources.empty();
+  }
+
+  if (!answered) {
+    OIC_LOG_V(DEBUG, TAG, "no answer from %s, trying multicast\n",
+              context->host.c_str());
+    forgetHost(context->host);
+    handleFindResources(context->request);
+    return;
+  }
+
+  findPreparedRequest(context, windowMs);
+}
+
+void IotivityClient::findDeviceUnicastRequest(
+  const DiscoveryContextPtr& context, double windowMs) {
+  bool answered;
+  {
+    std::lock_guard<std::mutex> lock(context->lock);
+    answered = context->devices.count(context->deviceId) != 0;
+  }
+
+  if (!answered) {
+    OIC_LOG_V(DEBUG, TAG, "no answer from %s, trying multicast\n",
+              context->host.c_str());
+    forgetHost(context->host);
+    handleFindDevices(context->request);
+    return;
+  }
 
-  sleep(waitsec);
-  findPreparedRequest(value);
+  findDevicePreparedRequest(context, windowMs);
+}
+
+void IotivityClient::getDiscoveryCacheStats(picojson::object& object) {
+  m_discoveryCache.getStats(object);
+}
+
+void IotivityClient::getResourceStats(picojson::object& object) {
+  std::lock_guard<std::mutex> lock(m_resourceLock);
+  m_resourceIndex.getStats(object);
+}
+
+void IotivityClient::restoreDiscoveries(const std::string& path) {
+  IotivityDiscoveryStore store;
+  std::set<std::string> hosts;
+
+  m_discoveryPath = path;
+  if (!store.load(path)) {
+    OIC_LOG_V(DEBUG, TAG, "no saved discoveries in %s\n", path.c_str());
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_resourceLock);
+    for (auto const &saved : store.m_resources) {
+      std::shared_ptr<OCResource> resource =
+        OCPlatform::constructResourceObject(saved.host, saved.uri,
+          static_cast<OCConnectivityType>(saved.connectivityType),
+          saved.observable, saved.resourceTypes, saved.interfaces);
+      if (!resource) {
+        continue;
+      }
+
+      IotivityResourceClientPtr resClient =
+        std::make_shared<IotivityResourceClient>(m_device);
+      resClient->setSharedPtr(resource);
+      resClient->setDeviceId(saved.deviceId);
+      if (m_resourceIndex.insert(resClient) != resClient) {
+        continue;
+      }
+      m_restored.insert(resClient->getResourceId());
+      rememberHost(saved.deviceId, saved.host);
+      hosts.insert(saved.host);
+    }
+
+    if (m_resourceIndex.overBudget()) {
+      scheduleEviction();
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_callbackLockDevices);
+    for (auto const &saved : store.m_devices) {
+      auto uuid = saved.find("uuid");
+      if (uuid == saved.end()) {
+        continue;
+      }
+
+      IotivityDeviceInfo *deviceInfo = new IotivityDeviceInfo();
+      deviceInfo->m_deviceinfomap = saved;
+      m_devicemap[uuid->second] = deviceInfo;
+    }
+  }
+
+  m_discoveryCache.restore(store.m_entries);
+  OIC_LOG_V(DEBUG, TAG, "restored %d resources, %d devices from %s\n",
+            static_cast<int>(store.m_resources.size()),
+            static_cast<int>(store.m_devices.size()), path.c_str());
+
+  // Restored results answer until a host proves them wrong
+  subscribePresence();
+
+  double refreshId = 0;
+  for (auto const &host : hosts) {
+    refreshHost(host, --refreshId);
+  }
+}
+
+// Called once the index went over budget, eviction runs on the timer
+// thread so never under the locks of the caller
+void IotivityClient::scheduleEviction() {
+  if (m_evictPending.exchange(true)) {
+    return;
+  }
+
+  scheduleTimer(0, [this]() {
+    m_evictPending = false;
+    evictResources();
+  });
+}
+
+// Discoveries and running requests share the evicted resources, the last
+// of them frees each one. Observed and busy resources stay indexed so
+// pages can still address them by id.
+void IotivityClient::evictResources() {
+  std::vector<IotivityResourceClientPtr> evicted;
+  std::vector<std::string> ids;
+  {
+    std::lock_guard<std::mutex> lock(m_resourceLock);
+    m_resourceIndex.evict([](const IotivityResourceClientPtr& resClient) {
+      return resClient->isEvictable();
+    }, evicted);
+
+    for (auto const &resClient : evicted) {
+      ids.push_back(resClient->getResourceId());
+      m_restored.erase(ids.back());
+    }
+  }
+
+  if (evicted.empty()) {
+    return;
+  }
+
+  OIC_LOG_V(DEBUG, TAG, "evicted %d resources\n",
+            static_cast<int>(evicted.size()));
+  postResourcesEvicted(ids);
+  schedulePersist();
+}
+
+// Pages drop the resources they held under these ids
+void IotivityClient::postResourcesEvicted(
+  const std::vector<std::string>& ids) {
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("resourcesEvicted");
+  writer.key("ids");
+  writer.stringArray(ids);
+  writer.endObject();
+  m_device->PostMessage(writer);
+}
+
+void IotivityClient::schedulePersist() {
+  if (m_discoveryPath == "" || m_persistPending.exchange(true)) {
+    return;
+  }
+
+  scheduleTimer(kPersistDelayMs, [this]() {
+    m_persistPending = false;
+    persistDiscoveries();
+  });
+}
+
+void IotivityClient::persistDiscoveries() {
+  IotivityDiscoveryStore store;
+
+  {
+    std::lock_guard<std::mutex> lock(m_resourceLock);
+    std::vector<IotivityResourceClientPtr> resources;
+    m_resourceIndex.resources(resources);
+
+    for (auto const &resClient : resources) {
+      std::shared_ptr<OCResource> resource = resClient->getSharedPtr();
+      if (!resource) {
+        continue;
+      }
+
+      IotivityDiscoveryStore::Resource entry;
+      entry.host = resource->host();
+      entry.uri = resource->uri();
+      entry.deviceId = resClient->getDeviceId();
+      entry.connectivityType = resource->connectivityType();
+      entry.observable = resource->isObservable();
+      entry.resourceTypes = resource->getResourceTypes();
+      entry.interfaces = resource->getResourceInterfaces();
+      store.m_resources.push_back(entry);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_callbackLockDevices);
+    for (auto const &entity : m_devicemap) {
+      store.m_devices.push_back(entity.second->m_deviceinfomap);
+    }
+  }
+
+  m_discoveryCache.snapshot(store.m_entries);
+
+  if (!store.save(m_discoveryPath)) {
+    OIC_LOG_V(ERROR, TAG, "cannot save discoveries to %s\n",
+              m_discoveryPath.c_str());
+  }
+}
+
+// Unicast discovery of a restored host, its answer confirms or replaces
+// what was restored
+void IotivityClient::refreshHost(const std::string& host, double refreshId) {
+  picojson::object request;
+  request["asyncCallId"] = picojson::value(refreshId);
+  request["OicDiscoveryOptions"] = picojson::value(picojson::object());
+
+  DiscoveryContextPtr context = newDiscovery(picojson::value(request),
+                                             &IotivityClient::refreshCompleted);
+  context->host = host;
+
+  FindCallback resourceHandler =
+    std::bind(&IotivityClient::foundResourceCallback,
+              this, std::placeholders::_1,
+              context);
+
+  OCStackResult result = OCPlatform::findResource(host,
+                         OC_RSRVD_WELL_KNOWN_URI, CT_DEFAULT, resourceHandler);
+  if (OC_STACK_OK != result) {
+    OIC_LOG_V(ERROR, TAG, "refresh of %s failed %d\n", host.c_str(), result);
+    m_discoveryCache.invalidateHost(host);
+    return;
+  }
+
+  openDiscoveryWindow(context);
+}
+
+void IotivityClient::refreshCompleted(const DiscoveryContextPtr& context,
+                                      double windowMs) {
+  std::map<std::string, IotivityResourceClientPtr> found;
+  std::set<std::string> answered;
+  std::vector<std::string> removed;
+  bool changed = false;
+
+  {
+    std::lock_guard<std::mutex> lock(context->lock);
+    found.swap(context->resources);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_resourceLock);
+    for (auto const &entity : found) {
+      answered.insert(entity.first);
+
+      // Restored objects stay valid, pages may already hold them
+      if (m_resourceIndex.insert(entity.second) == entity.second) {
+        changed = true;
+      }
+    }
+
+    if (m_resourceIndex.overBudget()) {
+      scheduleEviction();
+    }
+
+    IotivityResourceIndex::Query query;
+    std::vector<std::string> ids;
+    query.hosts.push_back(context->host);
+    m_resourceIndex.query(query, ids);
+
+    for (auto const &id : ids) {
+      if (answered.count(id)) {
+        m_restored.erase(id);
+        continue;
+      }
+
+      changed = true;
+      // Restored but no longer served, it would be saved again forever
+      if (m_restored.erase(id)) {
+        m_resourceIndex.remove(id);
+        removed.push_back(id);
+      }
+    }
+  }
+
+  if (!removed.empty()) {
+    postResourcesEvicted(removed);
+  }
+
+  OIC_LOG_V(DEBUG, TAG, "refresh of %s: %d resources, %s\n",
+            context->host.c_str(), static_cast<int>(answered.size()),
+            changed ? "changed" : "unchanged");
+
+  if (changed) {
+    m_discoveryCache.invalidateHost(context->host);
+    schedulePersist();
+  }
+}
+
+// Changes since the generation the page knows, or every resource as added
+// when it knows another one
+void IotivityClient::writeDiscoveryDiff(IotivityMessageWriter& writer,
+                                        const DiscoveryContextPtr& context) {
+  const std::map<std::string, IotivityResourceClientPtr>& current =
+    context->resources;
+  std::map<std::string, std::string> fingerprints;
+
+  for (auto const &entity : current) {
+    fingerprints[entity.first] = Fingerprint(entity.second);
+  }
+
+  std::lock_guard<std::mutex> lock(m_snapshotLock);
+  DiscoverySnapshot& snapshot = m_snapshots[context->cacheKey];
+  bool full = snapshot.generation == 0 ||
+              context->since != static_cast<double>(snapshot.generation);
+  std::vector<IotivityResourceClientPtr> added;
+  std::vector<IotivityResourceClientPtr> changed;
+  std::vector<std::string> removed;
+
+  for (auto const &entity : current) {
+    auto it = snapshot.fingerprints.find(entity.first);
+    if (full || it == snapshot.fingerprints.end()) {
+      added.push_back(entity.second);
+    } else if (it->second != fingerprints[entity.first]) {
+      changed.push_back(entity.second);
+    }
+  }
+
+  for (auto const &entity : snapshot.fingerprints) {
+    if (!full && !current.count(entity.first)) {
+      removed.push_back(entity.first);
+    }
+  }
+
+  if (snapshot.generation == 0 || snapshot.fingerprints != fingerprints) {
+    snapshot.generation = ++m_lastGeneration;
+    snapshot.fingerprints.swap(fingerprints);
+  }
+
+  writer.key("generation");
+  writer.value(static_cast<double>(snapshot.generation));
+  writer.key("full");
+  writer.value(full);
+
+  writer.key("added");
+  writer.beginArray();
+  for (auto const &resClient : added) {
+    resClient->serializeObject(writer);
+  }
+  writer.endArray();
+
+  writer.key("changed");
+  writer.beginArray();
+  for (auto const &resClient : changed) {
+    resClient->serializeObject(writer);
+  }
+  writer.endArray();
+
+  writer.key("removed");
+  writer.stringArray(removed);
+}
+
+void IotivityClient::findPreparedRequest(const DiscoveryContextPtr& context,
+                                         double windowMs) {
+  std::lock_guard<std::mutex> lock(context->lock);
+  double async_call_id = context->asyncCallId;
+  // Resources were already posted one by one, only completion is left
+  bool streaming = context->streaming;
+  // Snapshots are kept per filter, as for the cache
+  bool diff = context->diff && !streaming && context->cacheKey != "";
+  bool listed = !streaming && !diff;
+
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("foundResourceCallback");
+  writer.key("asyncCallId");
+  writer.value(async_call_id);
+  writer.key("streamed");
+  writer.value(streaming);
+  writer.key("window");
+  writer.value(windowMs);
+  writer.key("cached");
+  writer.value(context->cached);
+
+  if (listed) {
+    writer.key("resourcesArray");
+    writer.beginArray();
+  }
+
+  std::lock_guard<std::mutex> resourceLock(m_resourceLock);
+
+  // Known resources are answered with the object pages already use
+  for (auto &entity : context->resources) {
+    entity.second = m_resourceIndex.insert(entity.second);
+
+    if (listed) {
+      entity.second->serializeObject(writer);
+    }
+  }
+
+  if (m_resourceIndex.overBudget()) {
+    scheduleEviction();
+  }
+
+  if (listed) {
+    writer.endArray();
+  }
+
+  if (diff) {
+    writeDiscoveryDiff(writer, context);
+  }
+
+  // Only complete windows are worth answering from
+  if (context->closed && !context->cached && context->cacheKey != "") {
+    std::vector<std::string> ids;
+    for (auto const &entity : context->resources) {
+      ids.push_back(entity.first);
+    }
+    m_discoveryCache.store(context->cacheKey, context->host, ids,
+                           context->cacheGeneration);
+    schedulePersist();
+  }
+
+  writer.endObject();
+  m_device->getStats()->commandCompleted("foundResourceCallback",
+                                         async_call_id, false);
+  m_device->PostMessage(writer);
 }
 
 void IotivityClient::foundDeviceCallback(const OCRepresentation &rep,
-    const picojson::value &value) {
+    const DiscoveryContextPtr& context) {
   OIC_LOG_V(DEBUG, TAG, "\n###foundDeviceCallback:\n");
-  int waitsec = GetWait(value);
+  int waitsec = context->waitsec;
   std::string val;
   std::string values[] = {
     "di", "Device ID        ", "n", "Device name      ", "lcv",
@@ -157,20 +1100,24 @@ void IotivityClient::foundDeviceCallback(const OCRepresentation &rep,
     }
   }
 
-  PrintfOcRepresentation(rep);
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_IN,
+                 rep.numberOfAttributes(), 0);
 
   // Populate device info if "di"
   if (rep.getValue("di", val)) {
     std::string deviceUUID = val;
 
     IotivityDeviceInfo *deviceInfo = NULL;
+    std::unique_lock<std::mutex> lock(m_callbackLockDevices);
     std::map<std::string, IotivityDeviceInfo *>::const_iterator it;
-    it = m_founddevicemap.find(deviceUUID);
+    it = m_devicemap.find(deviceUUID);
 
-    if (it != m_founddevicemap.end()) {
-      deviceInfo = m_founddevicemap[deviceUUID];
+    if (it != m_devicemap.end()) {
+      // Known from an earlier discovery or restored, updated in place
+      deviceInfo = it->second;
     } else {
       deviceInfo = new IotivityDeviceInfo();
+      m_devicemap[deviceUUID] = deviceInfo;
     }
 
     deviceInfo->m_deviceinfomap["uuid"] = deviceUUID;
@@ -184,7 +1131,17 @@ void IotivityClient::foundDeviceCallback(const OCRepresentation &rep,
     if (rep.getValue("dmv", val)) {
       deviceInfo->m_deviceinfomap["dataModels"] = val;
     }
-    m_founddevicemap[deviceUUID] = deviceInfo;
+    lock.unlock();
+
+    {
+      std::lock_guard<std::mutex> lock(context->lock);
+      if (!context->closed) {
+        context->devices.insert(deviceUUID);
+      }
+    }
+
+    rememberHost(deviceUUID, rep.getHost());
+    discoveryResponse(context);
 
     // Get platfrom info from host, require IOT-828
     std::string hostUri = rep.getHost();  //  unicast
@@ -202,14 +1159,13 @@ void IotivityClient::foundDeviceCallback(const OCRepresentation &rep,
                            CT_ADAPTER_IP, platformInfoHandler);
 
     if (OC_STACK_OK != result) {
-      double async_call_id = value.get("asyncCallId").get<double>();
-      m_device->postError("OCPlatform::getPlatformInfo", async_call_id);
+      m_device->postError("OCPlatform::getPlatformInfo", context->asyncCallId);
       return;
     }
 
   } else {
     if (waitsec == -1) {
-      findDevicePreparedRequest(value);
+      findDevicePreparedRequest(context, 0);
     }
   }
 }
@@ -240,21 +1196,23 @@ void IotivityClient::foundPlatformCallback(const OCRepresentation &rep,
     }
   }
 
-  PrintfOcRepresentation(rep);
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_IN,
+                 rep.numberOfAttributes(), 0);
 
   // Populate device info if "di"
   if (rep.getValue("pi", val)) {
     // device id must exist since platform request follows device request
     IotivityDeviceInfo *deviceInfo = NULL;
+    std::lock_guard<std::mutex> lock(m_callbackLockDevices);
     std::map<std::string, IotivityDeviceInfo *>::const_iterator it;
-    it = m_founddevicemap.find(deviceUUID);
+    it = m_devicemap.find(deviceUUID);
 
     // device map should find deviceUUID
-    if (it != m_founddevicemap.end()) {
-      deviceInfo = m_founddevicemap[deviceUUID];
+    if (it != m_devicemap.end()) {
+      deviceInfo = it->second;
     } else {
       deviceInfo = new IotivityDeviceInfo();
-      m_founddevicemap[deviceUUID] = deviceInfo;
+      m_devicemap[deviceUUID] = deviceInfo;
     }
 
     if (rep.getValue("pi", val)) {
@@ -293,25 +1251,35 @@ void IotivityClient::foundPlatformCallback(const OCRepresentation &rep,
   }
 }
 
-IotivityResourceClient *IotivityClient::getResourceById(std::string id) {
+IotivityResourceClientPtr IotivityClient::getResourceById(std::string id) {
   OIC_LOG_V(DEBUG, TAG, "getResourceById: id=%s\n", id.c_str());
-  if (m_resourcemap.size()) {
-    std::map<std::string, IotivityResourceClient *>::const_iterator it;
-    if ((it = m_resourcemap.find(id)) != m_resourcemap.end()) {
-      return (*it).second;
-    }
+  std::lock_guard<std::mutex> lock(m_resourceLock);
+  // Resource ids only, a device has many: see queryResources({deviceId})
+  IotivityResourceClientPtr resClient = m_resourceIndex.find(id);
+
+  if (resClient != NULL) {
+    m_resourceIndex.touch(resClient->getResourceId());
   }
 
-  return NULL;
+  return resClient;
 }
 
-void IotivityClient::handleCancelObserving(const picojson::value &value) {
-  OIC_LOG_V(DEBUG, TAG, "handleCancelObserving: v=%s\n",
-    value.serialize().c_str());
+void IotivityClient::queryResources(const picojson::value &filter,
+                                    std::vector<std::string> &ids) {
+  IotivityResourceIndex::Query query;
+  query.deviceIds = GetStrings(filter, "deviceId");
+  query.hosts = GetStrings(filter, "host");
+  query.resourceTypes = GetStrings(filter, "resourceType");
+  query.interfaces = GetStrings(filter, "interface");
 
+  std::lock_guard<std::mutex> lock(m_resourceLock);
+  m_resourceIndex.query(query, ids);
+}
+
+void IotivityClient::handleCancelObserving(const picojson::value &value) {
   double async_call_id = value.get("asyncCallId").get<double>();
   std::string resId = value.get("id").to_str();
-  IotivityResourceClient *resClient = getResourceById(resId);
+  IotivityResourceClientPtr resClient = getResourceById(resId);
 
   if (resClient != NULL) {
     OCStackResult result = resClient->cancelObserving(async_call_id);
@@ -326,15 +1294,14 @@ void IotivityClient::handleCancelObserving(const picojson::value &value) {
   m_device->postResult("cancelObservingCompleted", async_call_id);
 }
 
-void IotivityClient::handleCreateResource(const picojson::value &value) {
+void IotivityClient::handleCreateResource(const picojson::value &value,
+                                          OCRepresentation* properties) {
   // Post + particular data
-  OIC_LOG_V(DEBUG, TAG, "handleCreateResource: v=%s\n",
-    value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
-  IotivityResourceInit oicResourceInit(value.get("OicResourceInit"));
+  IotivityResourceInit oicResourceInit(value.get("OicResourceInit"),
+                                       properties);
   std::string resId = value.get("id").to_str();
-  IotivityResourceClient *resClient = getResourceById(resId);
+  IotivityResourceClientPtr resClient = getResourceById(resId);
 
   if (resClient != NULL) {
     OCStackResult result =
@@ -349,12 +1316,9 @@ void IotivityClient::handleCreateResource(const picojson::value &value) {
 }
 
 void IotivityClient::handleDeleteResource(const picojson::value &value) {
-  OIC_LOG_V(DEBUG, TAG, "handleDeleteResource: v=%s\n",
-    value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   std::string resId = value.get("id").to_str();
-  IotivityResourceClient *resClient = getResourceById(resId);
+  IotivityResourceClientPtr resClient = getResourceById(resId);
 
   if (resClient != NULL) {
     OCStackResult result = resClient->deleteResource(async_call_id);
@@ -368,8 +1332,6 @@ void IotivityClient::handleDeleteResource(const picojson::value &value) {
 }
 
 void IotivityClient::handleFindDevices(const picojson::value &value) {
-  OIC_LOG_V(DEBUG, TAG, "handleFindDevices: v=%s\n", value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   picojson::value param = value.get("OicDiscoveryOptions");
 
@@ -391,24 +1353,49 @@ void IotivityClient::handleFindDevices(const picojson::value &value) {
     "\ttimeout = %d\n",
     deviceId.c_str(), waitsec);
 
-  for (auto const &entity : m_founddevicemap) {
-    IotivityDeviceInfo *deviceInfo = entity.second;
-    delete deviceInfo;
+  DiscoveryContextPtr context =
+    newDiscovery(value, &IotivityClient::findDevicePreparedRequest);
+  if (!context) {
+    m_device->postError("invalid discovery options", async_call_id);
+    return;
   }
-
-  m_founddevicemap.clear();
-
   std::string hostUri = "";  //  multicast
   std::string deviceDiscoveryURI = "/oic/d";
   std::string deviceDiscoveryRequest = OC_MULTICAST_PREFIX +
                                        deviceDiscoveryURI;
 
+  if (param.contains("host")) {
+    hostUri = param.get("host").to_str();
+  } else if (deviceId != "" && (hostUri = knownHost(deviceId)) != "") {
+    context->reply = &IotivityClient::findDeviceUnicastRequest;
+  }
+
+  if (hostUri != "") {
+    deviceDiscoveryRequest = deviceDiscoveryURI;
+  }
+
   OIC_LOG_V(DEBUG, TAG, "process: hostUri=%s, uri1=%s, timeout=%ds\n",
             hostUri.c_str(), deviceDiscoveryRequest.c_str(), waitsec);
 
+  context->host = hostUri;
+  if (waitsec >= 0) {
+    context->cacheKey = IotivityDiscoveryCache::key(hostUri,
+                                                    deviceDiscoveryURI,
+                                                    deviceId);
+    context->cacheGeneration = m_discoveryCache.generation();
+
+    double maxAge = GetOption(param, "maxAge",
+                              std::numeric_limits<double>::infinity());
+    if (findCachedDevices(context, maxAge * 1000)) {
+      return;
+    }
+  }
+
+  subscribePresence();
+
   FindDeviceCallback deviceInfoHandler =
     std::bind(&IotivityClient::foundDeviceCallback, this,
-              std::placeholders::_1, value);
+              std::placeholders::_1, context);
 
   OCStackResult result = OCPlatform::getDeviceInfo(hostUri,
                          deviceDiscoveryRequest,
@@ -419,29 +1406,22 @@ void IotivityClient::handleFindDevices(const picojson::value &value) {
   }
 
   if (waitsec >= 0) {
-    std::thread exec(std::function<void(const picojson::value &value)>(
-                       std::bind(&IotivityClient::findDeviceTimerCallback,
-                                 this, std::placeholders::_1)),
-                     value);
-    exec.detach();
+    openDiscoveryWindow(context);
   }
 }
 
 void IotivityClient::handleFindResources(const picojson::value &value) {
-  OIC_LOG_V(DEBUG, TAG, "handleFindResources: v=%s\n",
-    value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   picojson::value param = value.get("OicDiscoveryOptions");
 
   // all properties are null by default, meaning “find all”
   // if resourceId is specified in full form, a direct retrieve is made
   // if resourceType is specified, a retrieve on /oic/res is made
+  // resourceType and interface may also be arrays, matching any of them
   // if resourceId is null, and deviceId not,
   // then only resources from that device are returned
   std::string deviceId = "";
   std::string resourceId = "";
-  std::string resourceType = "";
   int waitsec = GetWait(value);
 
   if (param.contains("deviceId")) {
@@ -452,44 +1432,81 @@ void IotivityClient::handleFindResources(const picojson::value &value) {
     resourceId = param.get("resourceId").to_str();
   }
 
-  if (param.contains("resourceType")) {
-    resourceType = param.get("resourceType").to_str();
+  DiscoveryContextPtr context =
+    newDiscovery(value, &IotivityClient::findPreparedRequest);
+  if (!context) {
+    m_device->postError("invalid discovery options", async_call_id);
+    return;
   }
+  std::string resourceType = Join(context->resourceTypes);
+  std::string resourceInterface = Join(context->interfaces);
 
   OIC_LOG_V(DEBUG, TAG,
     "handleFindResources: device = %s\n"
     "\tresource = %s\n"
     "\tresourceType = %s\n"
+    "\tinterface = %s\n"
     "\ttimeout = %d\n",
-    deviceId.c_str(), resourceId.c_str(), resourceType.c_str(), waitsec);
-
-  m_foundresourcemap.clear();
+    deviceId.c_str(), resourceId.c_str(), resourceType.c_str(),
+    resourceInterface.c_str(), waitsec);
 
-  std::string hostUri = "";
+  std::string hostUri = "";  //  multicast
   string discoveryUri = OC_RSRVD_WELL_KNOWN_URI;
+
+  // options.host, or the last endpoint of deviceId, is asked directly
+  if (param.contains("host")) {
+    hostUri = param.get("host").to_str();
+  } else if (deviceId != "" && (hostUri = knownHost(deviceId)) != "") {
+    context->reply = &IotivityClient::findUnicastRequest;
+  }
   string requestUri = discoveryUri;
 
-  if ((deviceId == "") && (resourceId == "") && (resourceType == "")) {
+  if ((deviceId == "") && (resourceId == "") && (resourceType == "") &&
+      (resourceInterface == "")) {
     // Find all
   } else {
     if (resourceId != "") {
-      IotivityResourceClient *resClient = getResourceById(resourceId);
+      IotivityResourceClientPtr resClient = getResourceById(resourceId);
 
       if (resClient == NULL) {
         m_device->postError("findResource failed", async_call_id);
       } else {
-        m_foundresourcemap[resourceId] = resClient;
-        findPreparedRequest(value);
+        context->resources[resClient->getResourceId()] = resClient;
+        if (context->streaming) {
+          postResourceFound(resClient, async_call_id);
+        }
+        findPreparedRequest(context, 0);
       }
 
       return;
     }
 
-    if (resourceType != "") {
+    // Servers filter on a single query, several types need them all
+    if (context->resourceTypes.size() == 1) {
       requestUri = discoveryUri + "?rt=" + resourceType;
+    } else if (context->resourceTypes.empty() &&
+               context->interfaces.size() == 1) {
+      requestUri = discoveryUri + "?if=" + resourceInterface;
+    }
+  }
+
+  // options.maxAge bounds the age of cached results in seconds, 0 to
+  // always discover again
+  context->host = hostUri;
+  if (waitsec >= 0) {
+    context->cacheKey = IotivityDiscoveryCache::key(hostUri,
+      resourceType + "?" + resourceInterface, deviceId);
+    context->cacheGeneration = m_discoveryCache.generation();
+
+    double maxAge = GetOption(param, "maxAge",
+                              std::numeric_limits<double>::infinity());
+    if (findCachedResources(context, maxAge * 1000)) {
+      return;
     }
   }
 
+  subscribePresence();
+
   OIC_LOG_V(DEBUG, TAG,
     "process: hostUri=%s, resId=%s, resType=%s, "
     "deviceId=%s, timeout=%ds\n",
@@ -499,7 +1516,7 @@ void IotivityClient::handleFindResources(const picojson::value &value) {
   FindCallback resourceHandler =
     std::bind(&IotivityClient::foundResourceCallback,
               this, std::placeholders::_1,
-              value);
+              context);
 
   OCStackResult result = OCPlatform::findResource(hostUri, requestUri,
                          CT_DEFAULT, resourceHandler);
@@ -509,21 +1526,14 @@ void IotivityClient::handleFindResources(const picojson::value &value) {
   }
 
   if (waitsec >= 0) {
-    std::thread exec(std::function<void(const picojson::value &value)>(
-                       std::bind(&IotivityClient::findResourceTimerCallback,
-                                 this, std::placeholders::_1)),
-                     value);
-    exec.detach();
+    openDiscoveryWindow(context);
   }
 }
 
 void IotivityClient::handleRetrieveResource(const picojson::value &value) {
-  OIC_LOG_V(DEBUG, TAG, "handleRetrieveResource: v=%s\n",
-    value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   std::string resId = value.get("id").to_str();
-  IotivityResourceClient *resClient = getResourceById(resId);
+  IotivityResourceClientPtr resClient = getResourceById(resId);
 
   if (resClient != NULL) {
     OCStackResult result = resClient->retrieveResource(async_call_id);
@@ -537,14 +1547,11 @@ void IotivityClient::handleRetrieveResource(const picojson::value &value) {
 }
 
 void IotivityClient::handleStartObserving(const picojson::value &value) {
-  OIC_LOG_V(DEBUG, TAG, "handleStartObserving: v=%s\n",
-    value.serialize().c_str());
-
   OCStackResult result;
   double async_call_id = value.get("asyncCallId").get<double>();
   std::string resId = value.get("id").to_str();
   OIC_LOG_V(DEBUG, TAG, "\tstartObserving resId = %s\n", resId.c_str());
-  IotivityResourceClient *resClient = getResourceById(resId);
+  IotivityResourceClientPtr resClient = getResourceById(resId);
 
   if (resClient != NULL) {
     result = resClient->startObserving(async_call_id);
@@ -558,25 +1565,25 @@ void IotivityClient::handleStartObserving(const picojson::value &value) {
   }
 }
 
-void IotivityClient::handleUpdateResource(const picojson::value &value) {
-  OIC_LOG_V(DEBUG, TAG, "handleUpdateResource: v=%s\n",
-    value.serialize().c_str());
-
+void IotivityClient::handleUpdateResource(const picojson::value &value,
+                                          OCRepresentation* properties) {
   double async_call_id = value.get("asyncCallId").get<double>();
-  picojson::value param = value.get("OicResource");
+  const picojson::value& param = value.get("OicResource");
   std::string resId = param.get("id").to_str();
-  IotivityResourceClient *resClient = getResourceById(resId);
+  IotivityResourceClientPtr resClient = getResourceById(resId);
 
   if (resClient != NULL) {
     bool doPost = value.get("doPost").get<bool>();
-    IotivityResourceInit oicResourceInit(param);
-
     OCStackResult result;
 
-    result =
-      resClient->updateResource(oicResourceInit.m_resourceRep,
-                                async_call_id,
-                                doPost);
+    if (properties != NULL) {
+      properties->setUri(param.get("url").to_str());
+      result = resClient->updateResource(*properties, async_call_id, doPost);
+    } else {
+      IotivityResourceInit oicResourceInit(param);
+      result = resClient->updateResource(oicResourceInit.m_resourceRep,
+                                         async_call_id, doPost);
+    }
 
     if (OC_STACK_OK != result) {
       m_device->postError("updateResource failed", async_call_id);
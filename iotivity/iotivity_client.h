@@ -30,49 +30,192 @@
 #ifndef IOTIVITY_IOTIVITY_CLIENT_H_
 #define IOTIVITY_IOTIVITY_CLIENT_H_
 
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include "iotivity/iotivity_tools.h"
 #include "iotivity/iotivity_resource.h"
+#include "iotivity/iotivity_resource_index.h"
+#include "iotivity/iotivity_discovery_cache.h"
+#include "iotivity/iotivity_dispatcher.h"
+#include "iotivity/iotivity_timer.h"
 
 class IotivityDevice;
 
 class IotivityClient {
  private:
   IotivityDevice* m_device;
-  // Map resourceId fullpath with pointer
-  std::map<std::string, IotivityResourceClient*> m_resourcemap;
-  std::map<std::string, IotivityResourceClient*> m_foundresourcemap;
-  std::mutex m_callbackLock;
+  // Known resources by id, device, host, type and interface, within
+  // a memory budget
+  IotivityResourceIndex m_resourceIndex;
+  // Handlers for different resources run on different workers
+  std::mutex m_resourceLock;
+  // Restored resources whose host has not confirmed them yet
+  std::set<std::string> m_restored;
+  std::atomic<bool> m_evictPending;
 
-  // Map device UUID with pointer
+  // Map device UUID with pointer, the info of every device seen so far
   std::map<std::string, IotivityDeviceInfo*> m_devicemap;
-  std::map<std::string, IotivityDeviceInfo*> m_founddevicemap;
   std::mutex m_callbackLockDevices;
 
+  // Completed discoveries, answered again without a multicast
+  IotivityDiscoveryCache m_discoveryCache;
+  // Presence of the hosts seen so far, a change invalidates the cache
+  OCPresenceHandle m_presenceHandle;
+  std::map<std::string, unsigned> m_presenceNonces;
+  std::mutex m_presenceLock;
+  // Last result of each discovery filter answered in diff mode,
+  // as resource id to fingerprint
+  struct DiscoverySnapshot {
+    uint64_t generation;
+    std::map<std::string, std::string> fingerprints;
+  };
+  std::map<std::string, DiscoverySnapshot> m_snapshots;
+  uint64_t m_lastGeneration;
+  std::mutex m_snapshotLock;
+
+  // Last known endpoint of each device, for unicast discoveries
+  struct KnownHost {
+    std::string host;
+    std::chrono::steady_clock::time_point seen;
+  };
+  std::map<std::string, KnownHost> m_hosts;
+  std::mutex m_hostLock;
+
+  // Saved discovery results, empty until restoreDiscoveries
+  std::string m_discoveryPath;
+  std::atomic<bool> m_persistPending;
+
+  // Pending discovery replies, cancelled on destruction
+  std::set<IotivityTimerWheel::TimerId> m_timers;
+  std::mutex m_timerLock;
+
+  struct DiscoveryContext;
+  typedef std::shared_ptr<DiscoveryContext> DiscoveryContextPtr;
+
+  // Posts the results of a discovery, windowMs is how long it listened
+  typedef void (IotivityClient::*ReplyHandler)(
+    const DiscoveryContextPtr& context, double windowMs);
+
+  // State of a single findResources or findDevices call, shared by its
+  // stack callbacks and timers so concurrent discoveries never contend
+  struct DiscoveryContext {
+    picojson::value request;
+    double asyncCallId;
+    std::string host;
+    std::string deviceId;
+    // A resource matches with any of its types and any of its interfaces,
+    // empty lists match everything
+    std::vector<std::string> resourceTypes;
+    std::vector<std::string> interfaces;
+    bool streaming;
+    // Reply with the changes since generation `since` only
+    bool diff;
+    double since;
+    int waitsec;
+    ReplyHandler reply;
+
+    std::mutex lock;
+    // Set when the window closes, later responses are dropped
+    bool closed;
+    // Found resources by resource id, merged into m_resourceIndex on reply
+    std::map<std::string, IotivityResourceClientPtr> resources;
+    // Found device UUIDs, their info is read from m_devicemap on reply
+    std::set<std::string> devices;
+    // Cache entry answering the same filters, empty if not cacheable
+    std::string cacheKey;
+    uint64_t cacheGeneration;
+    bool cached;
+
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point last;
+    // Running average of the time between two responses
+    double gapMs;
+    unsigned responses;
+    // Adaptive windows close after quietFactor * gapMs without response,
+    // fixed ones after maxMs
+    bool adaptive;
+    double minMs;
+    double maxMs;
+    double quietFactor;
+  };
+
+  // Discoveries with an open window by asyncCallId
+  std::map<double, DiscoveryContextPtr> m_discoveries;
+  std::mutex m_discoveryLock;
+
+  void scheduleTimer(unsigned delayMs,
+                     const IotivityTimerWheel::Callback& callback);
+  // Null when the window options are invalid
+  DiscoveryContextPtr newDiscovery(const picojson::value& value,
+                                   ReplyHandler reply);
+  void openDiscoveryWindow(const DiscoveryContextPtr& context);
+  void discoveryResponse(const DiscoveryContextPtr& context);
+  void checkDiscoveryWindow(const DiscoveryContextPtr& context);
+  bool findCachedResources(const DiscoveryContextPtr& context,
+                           double maxAgeMs);
+  bool findCachedDevices(const DiscoveryContextPtr& context, double maxAgeMs);
+  void subscribePresence();
+  void schedulePersist();
+  void persistDiscoveries();
+  void scheduleEviction();
+  void evictResources();
+  void postResourcesEvicted(const std::vector<std::string>& ids);
+  void refreshHost(const std::string& host, double refreshId);
+  void refreshCompleted(const DiscoveryContextPtr& context, double windowMs);
+  void writeDiscoveryDiff(IotivityMessageWriter& writer,
+                          const DiscoveryContextPtr& context);
+  void rememberHost(const std::string& deviceId, const std::string& host);
+  std::string knownHost(const std::string& deviceId);
+  void forgetHost(const std::string& host);
+  void findUnicastRequest(const DiscoveryContextPtr& context,
+                          double windowMs);
+  void findDeviceUnicastRequest(const DiscoveryContextPtr& context,
+                                double windowMs);
+
  public:
   explicit IotivityClient(IotivityDevice* device);
   ~IotivityClient();
 
-  IotivityResourceClient* getResourceById(std::string id);
+  static void registerHandlers(IotivityDispatcher* dispatcher,
+                               IotivityDevice* device);
+
+  // Null when unknown, the resource outlives its eviction while held
+  IotivityResourceClientPtr getResourceById(std::string id);
+  // Ids of the known resources matching the deviceId, host, resourceType
+  // and interface options of filter
+  void queryResources(const picojson::value& filter,
+                      std::vector<std::string>& ids);
+  void restoreDiscoveries(const std::string& path);
+  void getDiscoveryCacheStats(picojson::object& object);
+  void getResourceStats(picojson::object& object);
 
-  void findDevicePreparedRequest(const picojson::value& value);
-  void findDeviceTimerCallback(const picojson::value& value);
-  void findPreparedRequest(const picojson::value& value);
-  void findResourceTimerCallback(const picojson::value& value);
+  void findDevicePreparedRequest(const DiscoveryContextPtr& context,
+                                 double windowMs);
+  void findPreparedRequest(const DiscoveryContextPtr& context,
+                           double windowMs);
+  void postResourceFound(const IotivityResourceClientPtr& resClient,
+                         double async_call_id);
 
   void foundDeviceCallback(const OCRepresentation& rep,
-                           const picojson::value& value);
+                           const DiscoveryContextPtr& context);
   void foundPlatformCallback(const OCRepresentation& rep,
                              const std::string &deviceUUID);
   void foundResourceCallback(std::shared_ptr<OCResource> resource,
-                             const picojson::value& value);
+                             const DiscoveryContextPtr& context);
+  void presenceCallback(OCStackResult result, const unsigned int nonce,
+                        const std::string& host);
 
-  void handleCreateResource(const picojson::value& value);
+  void handleCreateResource(const picojson::value& value,
+                            OCRepresentation* properties);
   void handleFindDevices(const picojson::value& value);
   void handleFindResources(const picojson::value& value);
   void handleRetrieveResource(const picojson::value& value);
-  void handleUpdateResource(const picojson::value& value);
+  void handleUpdateResource(const picojson::value& value,
+                            OCRepresentation* properties);
   void handleDeleteResource(const picojson::value& value);
   void handleStartObserving(const picojson::value& value);
   void handleCancelObserving(const picojson::value& value);
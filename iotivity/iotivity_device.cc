@@ -31,9 +31,21 @@
 #include "common/extension.h"
 #include "iotivity/iotivity_server.h"
 #include "iotivity/iotivity_client.h"
+#include "iotivity/iotivity_cbor.h"
+#include "iotivity/iotivity_trace.h"
+
+static const size_t kEventRingSize = 1024;
+static const size_t kEventBatchSize = 64;
+static const size_t kEventFlushMs = 4;
+static const unsigned kTimerTickMs = 10;
+
+// Set by captureEvents() while a batch of commands runs on this thread
+static thread_local IotivityDevice::CapturedEvents* t_captured = NULL;
 
 const std::string DAT_FILE = "oic_xwalk_client.dat";
 const std::string DAT_PATH  = getUserHome() + "/" + DAT_FILE;
+const std::string DISCOVERY_FILE = "oic_xwalk_discovery.dat";
+const std::string DISCOVERY_PATH = getUserHome() + "/" + DISCOVERY_FILE;
 
 #if SECURE
 FILE* xwalk_client_fopen(const char *path, const char *mode) {
@@ -94,6 +106,7 @@ IotivityDeviceSettings::IotivityDeviceSettings() {
   // m_deviceInfo;
   m_role = "intermediate";
   m_connectionMode = "acked";
+  m_wireFormat = "json";
 }
 
 IotivityDeviceSettings::~IotivityDeviceSettings() {}
@@ -109,6 +122,9 @@ void IotivityDeviceSettings::deserialize(const picojson::value& value) {
   if (value.contains("connectionMode")) {
     m_connectionMode = value.get("connectionMode").to_str();
   }
+  if (value.contains("wireFormat")) {
+    m_wireFormat = value.get("wireFormat").to_str();
+  }
   if (value.contains("info")) {
     m_deviceInfo.deserialize(value);
   }
@@ -120,11 +136,50 @@ IotivityDevice::IotivityDevice(common::Instance* instance)
 IotivityDevice::IotivityDevice(common::Instance* instance,
                                IotivityDeviceSettings* settings) {
   m_instance = instance;
+  m_server = NULL;
+  m_client = NULL;
+  m_cborMessaging.store(false, std::memory_order_release);
+  m_eventQueue = NULL;
+  m_timers = new IotivityTimerWheel(kTimerTickMs);
+
+  size_t flushMs = GetEnvSize("IOTIVITY_FLUSH_MS", kEventFlushMs);
+
+  if (flushMs > 0) {
+    m_eventQueue = new IotivityEventQueue(
+      [instance](const char* msg) { instance->PostMessage(msg); },
+      GetEnvSize("IOTIVITY_EVENT_RING", kEventRingSize),
+      GetEnvSize("IOTIVITY_EVENT_BATCH", kEventBatchSize),
+      static_cast<unsigned>(flushMs));
+  }
 }
 
 IotivityDevice::~IotivityDevice() {
   delete m_server;
   delete m_client;
+  // Roles cancel their timers, what is left only posts messages
+  delete m_timers;
+  // Flushes what the roles posted last
+  delete m_eventQueue;
+}
+
+void IotivityDevice::registerHandlers(IotivityDispatcher* dispatcher) {
+  typedef void (IotivityDevice::*DeviceHandler)(const picojson::value&);
+  static const struct {
+    uint32_t id;
+    DeviceHandler handler;
+  } kHandlers[] = {
+    {CommandHash("configure"), &IotivityDevice::handleConfigure},
+    {CommandHash("factoryReset"), &IotivityDevice::handleFactoryReset},
+    {CommandHash("reboot"), &IotivityDevice::handleReboot},
+  };
+
+  for (auto const& entry : kHandlers) {
+    dispatcher->registerHandler(entry.id,
+      std::bind(entry.handler, this, std::placeholders::_1));
+  }
+
+  IotivityClient::registerHandlers(dispatcher, this);
+  IotivityServer::registerHandlers(dispatcher, this);
 }
 
 common::Instance* IotivityDevice::getInstance() { return m_instance; }
@@ -133,6 +188,10 @@ IotivityServer* IotivityDevice::getServer() { return m_server; }
 
 IotivityClient* IotivityDevice::getClient() { return m_client; }
 
+IotivityStats* IotivityDevice::getStats() { return &m_stats; }
+
+IotivityTimerWheel* IotivityDevice::getTimers() { return m_timers; }
+
 static void DuplicateString(char** targetString, std::string sourceString) {
   *targetString = new char[sourceString.length() + 1];
   strncpy(*targetString, sourceString.c_str(), (sourceString.length() + 1));
@@ -269,6 +328,11 @@ void IotivityDevice::configure(IotivityDeviceSettings* settings) {
   OIC_LOG_V(DEBUG, TAG, "OCPlatform::Configure: host=%s:%d\n",
     host.c_str(), port);
   OIC_LOG_V(DEBUG, TAG, "modeType=%d, QoS=%d\n", modeType, QoS);
+
+  // Resources can only be constructed once the platform is configured
+  if (m_client) {
+    m_client->restoreDiscoveries(DISCOVERY_PATH);
+  }
 }
 
 OCStackResult IotivityDevice::configurePlatformInfo(
@@ -373,13 +437,15 @@ OCStackResult IotivityDevice::configureDeviceInfo(
 }
 
 void IotivityDevice::handleConfigure(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleConfigure: v=%s\n", value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
 
   IotivityDeviceSettings deviceSettings;
   deviceSettings.deserialize(value.get("settings"));
 
+  // JS keeps accepting both encodings, so outbound can switch right away
+  m_cborMessaging.store(deviceSettings.m_wireFormat == "cbor",
+                        std::memory_order_release);
+
   if (deviceSettings.m_role == "client") {
     return;
   }
@@ -400,7 +466,12 @@ void IotivityDevice::handleConfigure(const picojson::value& value) {
     return;
   }
 
-  postResult("configureCompleted", async_call_id);
+  picojson::value::object object;
+  object["cmd"] = picojson::value("configureCompleted");
+  object["asyncCallId"] = picojson::value(async_call_id);
+  object["wireFormat"] =
+    picojson::value(isCborMessaging() ? "cbor" : "json");
+  PostMessage(picojson::value(object));
 }
 
 static void systemReboot() {
@@ -421,10 +492,105 @@ void IotivityDevice::handleReboot(const picojson::value& value) {
 }
 
 void IotivityDevice::PostMessage(const char* msg) {
-  OIC_LOG_V(DEBUG, TAG, "[Native==>JS] PostMessage: v=%s\n", msg);
+  size_t size = strlen(msg);
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_MESSAGE_OUT, size, 0);
+  m_stats.messageOut(size);
+
+  if (t_captured != NULL) {
+    t_captured->push_back(std::make_pair(std::string(msg, size), false));
+    return;
+  }
+
   m_instance->PostMessage(msg);
 }
 
+void IotivityDevice::PostMessage(const picojson::value& value) {
+  m_stats.messagePosted(value);
+
+  if (m_eventQueue != NULL || t_captured != NULL) {
+    std::string payload;
+    bool cbor = isCborMessaging();
+
+    if (cbor) {
+      EncodeCbor(value, payload);
+    } else {
+      payload = value.serialize();
+    }
+
+    IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_MESSAGE_OUT, payload.size(),
+                   cbor);
+    m_stats.messageOut(payload.size());
+
+    if (t_captured != NULL) {
+      t_captured->push_back(std::make_pair(std::string(), cbor));
+      t_captured->back().first.swap(payload);
+    } else {
+      m_eventQueue->push(payload, cbor);
+    }
+  } else if (isCborMessaging()) {
+    std::string msg;
+    EncodeCborMessage(value, msg);
+    IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_MESSAGE_OUT, msg.size(), 1);
+    m_stats.messageOut(msg.size());
+    m_instance->PostMessage(msg.c_str());
+  } else {
+    PostMessage(value.serialize().c_str());
+  }
+}
+
+void IotivityDevice::PostMessage(IotivityMessageWriter& writer) {
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_MESSAGE_OUT,
+                 writer.payload().size(), writer.isCbor());
+  m_stats.messageOut(writer.payload().size());
+
+  if (t_captured != NULL) {
+    t_captured->push_back(std::make_pair(writer.payload(), writer.isCbor()));
+  } else if (m_eventQueue != NULL) {
+    m_eventQueue->push(writer.payload(), writer.isCbor());
+  } else {
+    m_instance->PostMessage(writer.message().c_str());
+  }
+}
+
+bool IotivityDevice::isCborMessaging() {
+  // Pairs with the release store in configure
+  return m_cborMessaging.load(std::memory_order_acquire);
+}
+
+void IotivityDevice::captureEvents(CapturedEvents* events) {
+  t_captured = events;
+}
+
+void IotivityDevice::postEvents(CapturedEvents& events) {
+  std::vector<std::string> run;
+  std::string batch;
+  std::string envelope;
+
+  // Already counted when captured, only the envelopes are posted
+  for (size_t i = 0; i < events.size(); i++) {
+    bool cbor = events[i].second;
+    run.push_back(std::string());
+    run.back().swap(events[i].first);
+
+    if (i + 1 < events.size() && events[i + 1].second == cbor) {
+      continue;
+    }
+
+    BuildEventBatch(run.data(), run.size(), cbor, batch);
+    run.clear();
+
+    if (cbor) {
+      envelope.assign(kCborMessagePrefix);
+      Base64Encode(batch, envelope);
+      m_instance->PostMessage(envelope.c_str());
+    } else {
+      m_instance->PostMessage(batch.c_str());
+    }
+  }
+
+  events.clear();
+}
+
 void IotivityDevice::postResult(const char* completed_operation,
                                 double async_operation_id) {
   OIC_LOG_V(DEBUG, TAG, "postResult: c=%s, id=%f\n", completed_operation,
@@ -435,7 +601,7 @@ void IotivityDevice::postResult(const char* completed_operation,
   object["asyncCallId"] = picojson::value(async_operation_id);
 
   picojson::value value(object);
-  PostMessage(value.serialize().c_str());
+  PostMessage(value);
 }
 
 void IotivityDevice::postError(const char* msg, double async_operation_id) {
@@ -446,7 +612,7 @@ void IotivityDevice::postError(const char* msg, double async_operation_id) {
   object["asyncCallId"] = picojson::value(async_operation_id);
 
   picojson::value value(object);
-  PostMessage(value.serialize().c_str());
+  PostMessage(value);
 }
 
 
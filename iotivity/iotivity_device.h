@@ -30,9 +30,17 @@
 #ifndef IOTIVITY_IOTIVITY_DEVICE_H_
 #define IOTIVITY_IOTIVITY_DEVICE_H_
 
+#include <atomic>
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 #include "iotivity/iotivity_tools.h"
+#include "iotivity/iotivity_dispatcher.h"
+#include "iotivity/iotivity_writer.h"
+#include "iotivity/iotivity_event_queue.h"
+#include "iotivity/iotivity_stats.h"
+#include "iotivity/iotivity_timer.h"
 #include "common/extension.h"
 #include "cacommon.h"
 
@@ -67,6 +75,7 @@ class IotivityDeviceSettings {
   IotivityDeviceInfo m_deviceInfo;
   std::string m_role;
   std::string m_connectionMode;
+  std::string m_wireFormat;
 
  public:
   IotivityDeviceSettings();
@@ -76,10 +85,19 @@ class IotivityDeviceSettings {
 };
 
 class IotivityDevice {
+ public:
+  // Payload and wire format of the events kept by captureEvents()
+  typedef std::vector<std::pair<std::string, bool>> CapturedEvents;
+
  private:
   common::Instance* m_instance;
   IotivityServer* m_server;
   IotivityClient* m_client;
+  std::atomic<bool> m_cborMessaging;
+  // NULL when IOTIVITY_FLUSH_MS is 0, messages are then posted directly
+  IotivityEventQueue* m_eventQueue;
+  IotivityStats m_stats;
+  IotivityTimerWheel* m_timers;
 
  public:
   explicit IotivityDevice(common::Instance* instance);
@@ -87,9 +105,13 @@ class IotivityDevice {
                           IotivityDeviceSettings* settings);
   ~IotivityDevice();
 
+  void registerHandlers(IotivityDispatcher* dispatcher);
+
   common::Instance* getInstance();
   IotivityServer* getServer();
   IotivityClient* getClient();
+  IotivityStats* getStats();
+  IotivityTimerWheel* getTimers();
 
   void configure(IotivityDeviceSettings* settings);
   OCStackResult configurePlatformInfo(IotivityDeviceInfo& deviceInfo);
@@ -99,6 +121,13 @@ class IotivityDevice {
   void handleFactoryReset(const picojson::value& value);
   void handleReboot(const picojson::value& value);
   void PostMessage(const char* msg);
+  void PostMessage(const picojson::value& value);
+  void PostMessage(IotivityMessageWriter& writer);
+  bool isCborMessaging();
+  // What the calling thread posts goes to |events| until called with NULL
+  void captureEvents(CapturedEvents* events);
+  // One "eventBatch" message per run of events of the same wire format
+  void postEvents(CapturedEvents& events);
   void postResult(const char* completed_operation, double async_operation_id);
   void postError(const char* msg, double async_operation_id);
 };
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_discovery_cache.h"
+
+#include <algorithm>
+
+IotivityDiscoveryCache::IotivityDiscoveryCache(double ttlMs)
+  : m_ttlMs(ttlMs), m_generation(0), m_hits(0), m_misses(0) {
+}
+
+std::string IotivityDiscoveryCache::key(const std::string& host,
+                                        const std::string& filter,
+                                        const std::string& deviceId) {
+  return host + '\n' + filter + '\n' + deviceId;
+}
+
+bool IotivityDiscoveryCache::lookup(const std::string& key, double maxAgeMs,
+                                    std::vector<std::string>& ids) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  auto it = m_entries.find(key);
+
+  if (it != m_entries.end()) {
+    double ageMs = std::chrono::duration<double, std::milli>(
+      Clock::now() - it->second.stored).count();
+
+    if (ageMs < std::min(maxAgeMs, m_ttlMs)) {
+      ids = it->second.ids;
+      m_hits++;
+      return true;
+    }
+
+    if (ageMs >= m_ttlMs) {
+      m_entries.erase(it);
+    }
+  }
+
+  m_misses++;
+  return false;
+}
+
+uint64_t IotivityDiscoveryCache::generation() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_generation;
+}
+
+void IotivityDiscoveryCache::store(const std::string& key,
+                                   const std::string& host,
+                                   const std::vector<std::string>& ids,
+                                   uint64_t generation) {
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  if (generation != m_generation || m_ttlMs <= 0) {
+    return;
+  }
+
+  Entry& entry = m_entries[key];
+  entry.stored = Clock::now();
+  entry.host = host;
+  entry.ids = ids;
+}
+
+void IotivityDiscoveryCache::invalidateHost(const std::string& host) {
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    if (it->second.host == "" || it->second.host == host) {
+      it = m_entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  m_generation++;
+}
+
+void IotivityDiscoveryCache::invalidate() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_entries.clear();
+  m_generation++;
+}
+
+void IotivityDiscoveryCache::snapshot(std::vector<SavedEntry>& entries) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  Clock::time_point now = Clock::now();
+
+  for (auto const &entity : m_entries) {
+    double ageMs = std::chrono::duration<double, std::milli>(
+      now - entity.second.stored).count();
+
+    if (ageMs < m_ttlMs) {
+      SavedEntry entry;
+      entry.key = entity.first;
+      entry.host = entity.second.host;
+      entry.ids = entity.second.ids;
+      entries.push_back(entry);
+    }
+  }
+}
+
+void IotivityDiscoveryCache::restore(const std::vector<SavedEntry>& entries) {
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  if (m_ttlMs <= 0) {
+    return;
+  }
+
+  for (auto const &saved : entries) {
+    Entry& entry = m_entries[saved.key];
+    entry.stored = Clock::now();
+    entry.host = saved.host;
+    entry.ids = saved.ids;
+  }
+}
+
+void IotivityDiscoveryCache::getStats(picojson::object& object) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  object["entries"] = picojson::value(static_cast<double>(m_entries.size()));
+  object["hits"] = picojson::value(static_cast<double>(m_hits));
+  object["misses"] = picojson::value(static_cast<double>(m_misses));
+  object["ttlMs"] = picojson::value(m_ttlMs);
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_DISCOVERY_CACHE_H_
+#define IOTIVITY_IOTIVITY_DISCOVERY_CACHE_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/picojson.h"
+
+// Results of completed resource discoveries, keyed by the host, resource
+// type and interface filter and device they were made with. Entries only
+// hold resource ids, the resources themselves stay in the client registry.
+//
+// Every invalidation bumps a generation, so a discovery started before it
+// cannot store what it found afterwards.
+class IotivityDiscoveryCache {
+ public:
+  typedef std::chrono::steady_clock Clock;
+
+  // Entry as persisted across restarts, without its age
+  struct SavedEntry {
+    std::string key;
+    std::string host;
+    std::vector<std::string> ids;
+  };
+
+ private:
+  struct Entry {
+    Clock::time_point stored;
+    std::string host;
+    std::vector<std::string> ids;
+  };
+
+  std::mutex m_lock;
+  std::map<std::string, Entry> m_entries;
+  double m_ttlMs;
+  uint64_t m_generation;
+  uint64_t m_hits;
+  uint64_t m_misses;
+
+ public:
+  explicit IotivityDiscoveryCache(double ttlMs);
+
+  static std::string key(const std::string& host,
+                         const std::string& filter,
+                         const std::string& deviceId);
+
+  // Ids stored under key at most maxAgeMs ago, and never beyond the TTL
+  bool lookup(const std::string& key, double maxAgeMs,
+              std::vector<std::string>& ids);
+  uint64_t generation();
+  void store(const std::string& key, const std::string& host,
+             const std::vector<std::string>& ids, uint64_t generation);
+
+  // Drops the entries of host, and the multicast ones it may be part of
+  void invalidateHost(const std::string& host);
+  void invalidate();
+
+  // Unexpired entries, and entries restored as if just stored
+  void snapshot(std::vector<SavedEntry>& entries);
+  void restore(const std::vector<SavedEntry>& entries);
+
+  void getStats(picojson::object& object);
+};
+
+#endif  // IOTIVITY_IOTIVITY_DISCOVERY_CACHE_H_
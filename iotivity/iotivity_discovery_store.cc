@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_discovery_store.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+static const char kMagic[4] = {'O', 'X', 'D', 'C'};
+static const uint32_t kVersion = 1;
+
+namespace {
+
+class StoreWriter {
+ public:
+  std::string m_buffer;
+
+  void u8(uint8_t value) { m_buffer.push_back(static_cast<char>(value)); }
+
+  void u16(uint16_t value) {
+    u8(value & 0xff);
+    u8(value >> 8);
+  }
+
+  void u32(uint32_t value) {
+    u16(value & 0xffff);
+    u16(value >> 16);
+  }
+
+  void str(const std::string& value) {
+    size_t size = std::min<size_t>(value.size(), 0xffff);
+    u16(static_cast<uint16_t>(size));
+    m_buffer.append(value, 0, size);
+  }
+
+  void strings(const std::vector<std::string>& values) {
+    size_t count = std::min<size_t>(values.size(), 0xffff);
+    u16(static_cast<uint16_t>(count));
+    for (size_t i = 0; i < count; i++) {
+      str(values[i]);
+    }
+  }
+};
+
+// Every read past the end fails the whole load
+class StoreReader {
+ private:
+  const uint8_t* m_data;
+  size_t m_size;
+  size_t m_pos;
+  bool m_ok;
+
+  bool need(size_t size) {
+    if (m_size - m_pos < size) {
+      m_ok = false;
+    }
+    return m_ok;
+  }
+
+ public:
+  StoreReader(const uint8_t* data, size_t size)
+    : m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+
+  bool ok() const { return m_ok; }
+
+  uint8_t u8() {
+    return need(1) ? m_data[m_pos++] : 0;
+  }
+
+  uint16_t u16() {
+    uint16_t low = u8();
+    return low | (static_cast<uint16_t>(u8()) << 8);
+  }
+
+  uint32_t u32() {
+    uint32_t low = u16();
+    return low | (static_cast<uint32_t>(u16()) << 16);
+  }
+
+  std::string str() {
+    uint16_t size = u16();
+    if (!need(size)) {
+      return "";
+    }
+    std::string value(reinterpret_cast<const char*>(m_data + m_pos), size);
+    m_pos += size;
+    return value;
+  }
+
+  void strings(std::vector<std::string>& values) {
+    uint16_t count = u16();
+    for (uint16_t i = 0; i < count && m_ok; i++) {
+      values.push_back(str());
+    }
+  }
+};
+
+}  // namespace
+
+bool IotivityDiscoveryStore::load(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 8) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  StoreReader reader(bytes + sizeof(kMagic), size - sizeof(kMagic));
+  bool valid = memcmp(bytes, kMagic, sizeof(kMagic)) == 0 &&
+               reader.u32() == kVersion;
+
+  uint32_t count = valid ? reader.u32() : 0;
+  for (uint32_t i = 0; i < count && reader.ok(); i++) {
+    Resource resource;
+    resource.host = reader.str();
+    resource.uri = reader.str();
+    resource.deviceId = reader.str();
+    resource.connectivityType = reader.u32();
+    resource.observable = reader.u8() != 0;
+    reader.strings(resource.resourceTypes);
+    reader.strings(resource.interfaces);
+    m_resources.push_back(resource);
+  }
+
+  count = valid ? reader.u32() : 0;
+  for (uint32_t i = 0; i < count && reader.ok(); i++) {
+    DeviceInfo device;
+    uint16_t pairs = reader.u16();
+    for (uint16_t j = 0; j < pairs && reader.ok(); j++) {
+      std::string key = reader.str();
+      device[key] = reader.str();
+    }
+    m_devices.push_back(device);
+  }
+
+  count = valid ? reader.u32() : 0;
+  for (uint32_t i = 0; i < count && reader.ok(); i++) {
+    IotivityDiscoveryCache::SavedEntry entry;
+    entry.key = reader.str();
+    entry.host = reader.str();
+    reader.strings(entry.ids);
+    m_entries.push_back(entry);
+  }
+
+  munmap(data, size);
+
+  if (!valid || !reader.ok()) {
+    m_resources.clear();
+    m_devices.clear();
+    m_entries.clear();
+    return false;
+  }
+
+  return true;
+}
+
+bool IotivityDiscoveryStore::save(const std::string& path) const {
+  StoreWriter writer;
+  writer.m_buffer.append(kMagic, sizeof(kMagic));
+  writer.u32(kVersion);
+
+  writer.u32(m_resources.size());
+  for (auto const &resource : m_resources) {
+    writer.str(resource.host);
+    writer.str(resource.uri);
+    writer.str(resource.deviceId);
+    writer.u32(resource.connectivityType);
+    writer.u8(resource.observable ? 1 : 0);
+    writer.strings(resource.resourceTypes);
+    writer.strings(resource.interfaces);
+  }
+
+  writer.u32(m_devices.size());
+  for (auto const &device : m_devices) {
+    size_t pairs = std::min<size_t>(device.size(), 0xffff);
+    writer.u16(static_cast<uint16_t>(pairs));
+    for (auto const &entity : device) {
+      if (pairs-- == 0) {
+        break;
+      }
+      writer.str(entity.first);
+      writer.str(entity.second);
+    }
+  }
+
+  writer.u32(m_entries.size());
+  for (auto const &entry : m_entries) {
+    writer.str(entry.key);
+    writer.str(entry.host);
+    writer.strings(entry.ids);
+  }
+
+  // Readers never see a partial file
+  std::string tmpPath = path + ".tmp";
+  FILE* file = fopen(tmpPath.c_str(), "wb");
+  if (file == NULL) {
+    return false;
+  }
+
+  bool written = fwrite(writer.m_buffer.data(), 1, writer.m_buffer.size(),
+                        file) == writer.m_buffer.size();
+  written = fclose(file) == 0 && written;
+
+  if (!written || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    unlink(tmpPath.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_DISCOVERY_STORE_H_
+#define IOTIVITY_IOTIVITY_DISCOVERY_STORE_H_
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "iotivity/iotivity_discovery_cache.h"
+
+// Discovery results saved across restarts, so the client can answer the
+// first discoveries before the network does.
+//
+// The file is a flat little-endian record stream read through mmap:
+// a header, then counted resources, devices and cache entries, strings
+// as a 16 bit length and bytes. It is replaced atomically on save.
+class IotivityDiscoveryStore {
+ public:
+  struct Resource {
+    std::string host;
+    std::string uri;
+    std::string deviceId;
+    uint32_t connectivityType;
+    bool observable;
+    std::vector<std::string> resourceTypes;
+    std::vector<std::string> interfaces;
+  };
+
+  typedef std::map<std::string, std::string> DeviceInfo;
+
+  std::vector<Resource> m_resources;
+  std::vector<DeviceInfo> m_devices;
+  std::vector<IotivityDiscoveryCache::SavedEntry> m_entries;
+
+  // False if the file is missing, of another version or truncated
+  bool load(const std::string& path);
+  bool save(const std::string& path) const;
+};
+
+#endif  // IOTIVITY_IOTIVITY_DISCOVERY_STORE_H_
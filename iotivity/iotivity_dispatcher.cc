@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_dispatcher.h"
+#include "iotivity/iotivity_tools.h"
+
+uint32_t CommandHash(const std::string& str) {
+  uint32_t hash = 2166136261u;
+
+  for (std::string::const_iterator it = str.begin(); it != str.end(); ++it) {
+    hash = (hash ^ static_cast<uint8_t>(*it)) * 16777619u;
+  }
+
+  return hash;
+}
+
+IotivityDispatcher::IotivityDispatcher() {}
+
+IotivityDispatcher::~IotivityDispatcher() {}
+
+bool IotivityDispatcher::registerHandler(uint32_t commandId,
+                                         const Handler& handler) {
+  if (m_handlers.find(commandId) != m_handlers.end() ||
+      propertiesPayload(commandId) != NULL) {
+    OIC_LOG_V(ERROR, TAG, "registerHandler: duplicate command id 0x%x\n",
+      commandId);
+    return false;
+  }
+
+  m_handlers[commandId] = handler;
+  return true;
+}
+
+bool IotivityDispatcher::registerPropertiesHandler(
+  uint32_t commandId, const std::string& payload,
+  const PropertiesHandler& handler) {
+  if (m_handlers.find(commandId) != m_handlers.end() ||
+      propertiesPayload(commandId) != NULL) {
+    OIC_LOG_V(ERROR, TAG,
+      "registerPropertiesHandler: duplicate command id 0x%x\n", commandId);
+    return false;
+  }
+
+  PropertiesEntry& entry = m_propertiesHandlers[commandId];
+  entry.payload = payload;
+  entry.handler = handler;
+  return true;
+}
+
+const std::string* IotivityDispatcher::propertiesPayload(
+  uint32_t commandId) const {
+  std::unordered_map<uint32_t, PropertiesEntry>::const_iterator it =
+    m_propertiesHandlers.find(commandId);
+
+  if (it == m_propertiesHandlers.end()) {
+    return NULL;
+  }
+
+  return &it->second.payload;
+}
+
+bool IotivityDispatcher::dispatch(uint32_t commandId,
+                                  const picojson::value& value,
+                                  OCRepresentation* properties) {
+  std::unordered_map<uint32_t, PropertiesEntry>::const_iterator pit =
+    m_propertiesHandlers.find(commandId);
+
+  if (pit != m_propertiesHandlers.end()) {
+    pit->second.handler(value, properties);
+    return true;
+  }
+
+  std::unordered_map<uint32_t, Handler>::const_iterator it =
+    m_handlers.find(commandId);
+
+  if (it == m_handlers.end()) {
+    return false;
+  }
+
+  it->second(value);
+  return true;
+}
+
+double GetAsyncCallId(const picojson::value& value) {
+  if (value.is<picojson::object>() && value.get("asyncCallId").is<double>()) {
+    return value.get("asyncCallId").get<double>();
+  }
+
+  return -1;
+}
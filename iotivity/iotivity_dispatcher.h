@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_DISPATCHER_H_
+#define IOTIVITY_IOTIVITY_DISPATCHER_H_
+
+#include <stdint.h>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include "common/picojson.h"
+
+namespace OC {
+class OCRepresentation;
+}
+
+// FNV-1a hash of a command name. Usable at compile time so that handler
+// tables are keyed on constants instead of std::string comparisons.
+constexpr uint32_t CommandHash(const char* str,
+                               uint32_t hash = 2166136261u) {
+  return (*str == '\0') ? hash :
+      CommandHash(str + 1,
+                  (hash ^ static_cast<uint8_t>(*str)) * 16777619u);
+}
+
+uint32_t CommandHash(const std::string& str);
+
+class IotivityDispatcher {
+ public:
+  typedef std::function<void(const picojson::value&)> Handler;
+  // |properties| is the pre-parsed payload "properties", NULL if the message
+  // went through the DOM path and the handler has to convert it itself
+  typedef std::function<void(const picojson::value&,
+                             OC::OCRepresentation*)> PropertiesHandler;
+
+ private:
+  std::unordered_map<uint32_t, Handler> m_handlers;
+  struct PropertiesEntry {
+    std::string payload;
+    PropertiesHandler handler;
+  };
+  std::unordered_map<uint32_t, PropertiesEntry> m_propertiesHandlers;
+
+ public:
+  IotivityDispatcher();
+  ~IotivityDispatcher();
+
+  bool registerHandler(uint32_t commandId, const Handler& handler);
+  // |payload| is the message key whose "properties" the handler consumes
+  bool registerPropertiesHandler(uint32_t commandId, const std::string& payload,
+                                 const PropertiesHandler& handler);
+  const std::string* propertiesPayload(uint32_t commandId) const;
+  bool dispatch(uint32_t commandId, const picojson::value& value,
+                OC::OCRepresentation* properties = NULL);
+};
+
+double GetAsyncCallId(const picojson::value& value);
+
+#endif  // IOTIVITY_IOTIVITY_DISPATCHER_H_
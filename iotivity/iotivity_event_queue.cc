@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_event_queue.h"
+
+#include <stdint.h>
+#include <vector>
+
+#include "iotivity/iotivity_cbor.h"
+#include "iotivity/iotivity_tools.h"
+
+static const char kBatchCommand[] = "eventBatch";
+
+IotivityEventQueue::IotivityEventQueue(const Sink& sink, size_t capacity,
+                                       size_t batchSize, unsigned flushMs)
+  : m_sink(sink), m_batchSize(batchSize ? batchSize : 1),
+    m_interval(flushMs), m_head(0), m_pending(0), m_stopping(false),
+    m_tail(0) {
+  size_t size = 2;
+
+  while (size < capacity) size <<= 1;
+
+  m_slots.reset(new Slot[size]);
+  m_mask = size - 1;
+
+  for (size_t i = 0; i < size; i++) {
+    m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    m_slots[i].cbor = false;
+  }
+
+  m_thread = std::thread(&IotivityEventQueue::run, this);
+}
+
+IotivityEventQueue::~IotivityEventQueue() {
+  m_stopping = true;
+  wake();
+  m_thread.join();
+}
+
+void IotivityEventQueue::wake() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_cond.notify_one();
+}
+
+void IotivityEventQueue::push(std::string& payload, bool cbor) {
+  size_t pos = m_head.load(std::memory_order_relaxed);
+  Slot* slot;
+
+  while (true) {
+    slot = &m_slots[pos & m_mask];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = static_cast<intptr_t>(sequence) -
+                    static_cast<intptr_t>(pos);
+
+    if (diff == 0) {
+      if (m_head.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // Ring full, let the flusher catch up
+      wake();
+      std::this_thread::yield();
+      pos = m_head.load(std::memory_order_relaxed);
+    } else {
+      pos = m_head.load(std::memory_order_relaxed);
+    }
+  }
+
+  // Counted before publishing so that pop() never sees m_pending wrap
+  size_t pending = m_pending.fetch_add(1) + 1;
+
+  slot->payload.swap(payload);
+  slot->cbor = cbor;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+
+  // Only the first event and a full batch need to wake the flusher
+  if (pending == 1 || pending == m_batchSize) {
+    wake();
+  }
+}
+
+bool IotivityEventQueue::pop(std::string& payload, bool& cbor) {
+  Slot& slot = m_slots[m_tail & m_mask];
+
+  if (slot.sequence.load(std::memory_order_acquire) != m_tail + 1) {
+    return false;
+  }
+
+  payload.swap(slot.payload);
+  slot.payload.clear();
+  cbor = slot.cbor;
+  slot.sequence.store(m_tail + m_mask + 1, std::memory_order_release);
+  m_tail++;
+  m_pending--;
+  return true;
+}
+
+void BuildEventBatch(const std::string* events, size_t count, bool cbor,
+                     std::string& batch) {
+  batch.clear();
+
+  if (count == 1) {
+    batch = events[0];
+  } else if (cbor) {
+    CborWriteHead(batch, 5, 2);
+    CborWriteHead(batch, 3, 3);
+    batch.append("cmd");
+    CborWriteHead(batch, 3, sizeof(kBatchCommand) - 1);
+    batch.append(kBatchCommand);
+    CborWriteHead(batch, 3, 6);
+    batch.append("events");
+    CborWriteHead(batch, 4, count);
+    for (size_t i = 0; i < count; i++) batch.append(events[i]);
+  } else {
+    batch.append("{\"cmd\":\"");
+    batch.append(kBatchCommand);
+    batch.append("\",\"events\":[");
+    for (size_t i = 0; i < count; i++) {
+      if (i) batch.push_back(',');
+      batch.append(events[i]);
+    }
+    batch.append("]}");
+  }
+}
+
+void IotivityEventQueue::post(const std::string* events, size_t count,
+                              bool cbor) {
+  if (count == 0) return;
+
+  BuildEventBatch(events, count, cbor, m_batch);
+
+  if (cbor) {
+    m_envelope.assign(kCborMessagePrefix);
+    Base64Encode(m_batch, m_envelope);
+    m_sink(m_envelope.c_str());
+  } else {
+    m_sink(m_batch.c_str());
+  }
+}
+
+void IotivityEventQueue::flush() {
+  std::vector<std::string> events;
+  bool runCbor = false;
+  std::string payload;
+  bool cbor;
+
+  // Events keep their order, a wire format switch starts a new batch
+  while (pop(payload, cbor)) {
+    if (!events.empty() &&
+        (cbor != runCbor || events.size() == m_batchSize)) {
+      post(events.data(), events.size(), runCbor);
+      events.clear();
+    }
+
+    runCbor = cbor;
+    events.push_back(std::string());
+    events.back().swap(payload);
+  }
+
+  if (events.size() > 1) {
+    OIC_LOG_V(DEBUG, TAG, "IotivityEventQueue: batch of %d events\n",
+      static_cast<int>(events.size()));
+  }
+
+  post(events.data(), events.size(), runCbor);
+}
+
+void IotivityEventQueue::run() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this] {
+        return m_stopping || m_pending.load() > 0;
+      });
+
+      // Give the stack a flush interval to add to the batch
+      m_cond.wait_for(lock, m_interval, [this] {
+        return m_stopping || m_pending.load() >= m_batchSize;
+      });
+    }
+
+    flush();
+
+    if (m_stopping && m_pending.load() == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_EVENT_QUEUE_H_
+#define IOTIVITY_IOTIVITY_EVENT_QUEUE_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Wraps |count| payloads of one wire format in an "eventBatch" message,
+// a single payload is copied unchanged. CBOR output is not base64 encoded.
+void BuildEventBatch(const std::string* events, size_t count, bool cbor,
+                     std::string& batch);
+
+// Coalesces outbound messages posted from OC stack threads.
+//
+// Producers push encoded payloads (JSON text or raw CBOR) into a bounded
+// lock-free ring. A single flusher thread drains it every flush interval,
+// or as soon as a batch is full, and hands each run of events to the sink
+// as one "eventBatch" message. A run of one event is posted unchanged.
+class IotivityEventQueue {
+ public:
+  typedef std::function<void(const char*)> Sink;
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    std::string payload;
+    bool cbor;
+  };
+
+  Sink m_sink;
+  std::unique_ptr<Slot[]> m_slots;
+  size_t m_mask;
+  size_t m_batchSize;
+  std::chrono::milliseconds m_interval;
+
+  std::atomic<size_t> m_head;
+  std::atomic<size_t> m_pending;
+  std::atomic<bool> m_stopping;
+  // Only touched by the flusher
+  size_t m_tail;
+  std::string m_batch;
+  std::string m_envelope;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::thread m_thread;
+
+  bool pop(std::string& payload, bool& cbor);
+  void flush();
+  void post(const std::string* events, size_t count, bool cbor);
+  void wake();
+  void run();
+
+ public:
+  IotivityEventQueue(const Sink& sink, size_t capacity, size_t batchSize,
+                     unsigned flushMs);
+  ~IotivityEventQueue();
+
+  // Takes the content of |payload|
+  void push(std::string& payload, bool cbor);
+};
+
+#endif  // IOTIVITY_IOTIVITY_EVENT_QUEUE_H_
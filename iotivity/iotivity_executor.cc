@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_executor.h"
+#include "iotivity/iotivity_tools.h"
+
+struct IotivityExecutor::Barrier {
+  std::mutex mutex;
+  std::condition_variable cond;
+  size_t pending;
+  bool done;
+  Task task;
+};
+
+static void UpdateMax(std::atomic<uint64_t>& max, uint64_t value) {
+  uint64_t current = max.load();
+
+  while (value > current && !max.compare_exchange_weak(current, value)) {
+  }
+}
+
+IotivityExecutor::IotivityExecutor(size_t workers, size_t capacity)
+  : m_capacity(capacity ? capacity : 1), m_stopping(false), m_submitted(0),
+    m_rejected(0), m_completed(0), m_depth(0), m_maxDepth(0),
+    m_waitTotalUs(0), m_waitMaxUs(0) {
+  if (workers == 0) workers = 1;
+
+  for (size_t i = 0; i < workers; i++) {
+    m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+  }
+
+  for (auto& worker : m_workers) {
+    worker->thread = std::thread(&IotivityExecutor::run, this, worker.get());
+  }
+
+  OIC_LOG_V(DEBUG, TAG, "IotivityExecutor: workers=%d, capacity=%d\n",
+    static_cast<int>(workers), static_cast<int>(m_capacity));
+}
+
+IotivityExecutor::~IotivityExecutor() {
+  m_stopping = true;
+
+  for (auto& worker : m_workers) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->cond.notify_one();
+  }
+
+  // Workers drain their queue before leaving
+  for (auto& worker : m_workers) {
+    worker->thread.join();
+  }
+
+  OIC_LOG_V(DEBUG, TAG, "IotivityExecutor: submitted=%llu, rejected=%llu, "
+    "maxDepth=%llu, maxWaitUs=%llu\n",
+    static_cast<unsigned long long>(m_submitted.load()),
+    static_cast<unsigned long long>(m_rejected.load()),
+    static_cast<unsigned long long>(m_maxDepth.load()),
+    static_cast<unsigned long long>(m_waitMaxUs.load()));
+}
+
+void IotivityExecutor::enqueue(Worker* worker, Item& item) {
+  item.queued = std::chrono::steady_clock::now();
+  worker->queue.push_back(std::move(item));
+  UpdateMax(m_maxDepth, ++m_depth);
+  worker->cond.notify_one();
+}
+
+bool IotivityExecutor::submit(const std::string& key, const Task& task) {
+  return submitTo(route(key), task);
+}
+
+size_t IotivityExecutor::route(const std::string& key) const {
+  return std::hash<std::string>()(key) % m_workers.size();
+}
+
+size_t IotivityExecutor::size() const { return m_workers.size(); }
+
+bool IotivityExecutor::submitTo(size_t index, const Task& task) {
+  Worker* worker = m_workers[index].get();
+  std::lock_guard<std::mutex> lock(worker->mutex);
+
+  if (worker->queue.size() >= m_capacity) {
+    m_rejected++;
+    return false;
+  }
+
+  Item item;
+  item.task = task;
+  enqueue(worker, item);
+  m_submitted++;
+  return true;
+}
+
+void IotivityExecutor::submitExclusive(const Task& task) {
+  std::shared_ptr<Barrier> barrier(new Barrier());
+  barrier->pending = m_workers.size();
+  barrier->done = false;
+  barrier->task = task;
+
+  // Barriers are not counted against the capacity, dropping a configure
+  // would leave the page waiting forever
+  std::lock_guard<std::mutex> exclusive(m_exclusiveMutex);
+
+  for (auto& worker : m_workers) {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    Item item;
+    item.barrier = barrier;
+    enqueue(worker.get(), item);
+  }
+
+  m_submitted++;
+}
+
+void IotivityExecutor::account(const Item& item) {
+  uint64_t waitUs = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - item.queued).count();
+
+  m_depth--;
+  m_waitTotalUs += waitUs;
+  UpdateMax(m_waitMaxUs, waitUs);
+}
+
+void IotivityExecutor::run(Worker* worker) {
+  while (true) {
+    Item item;
+
+    {
+      std::unique_lock<std::mutex> lock(worker->mutex);
+      worker->cond.wait(lock, [this, worker] {
+        return m_stopping || !worker->queue.empty();
+      });
+
+      if (worker->queue.empty()) {
+        return;
+      }
+
+      item = std::move(worker->queue.front());
+      worker->queue.pop_front();
+    }
+
+    account(item);
+
+    if (!item.barrier) {
+      item.task();
+      m_completed++;
+      continue;
+    }
+
+    // The last worker to reach the barrier runs the task
+    Barrier& barrier = *item.barrier;
+    std::unique_lock<std::mutex> lock(barrier.mutex);
+
+    if (--barrier.pending == 0) {
+      lock.unlock();
+      barrier.task();
+      m_completed++;
+      lock.lock();
+      barrier.done = true;
+      barrier.cond.notify_all();
+    } else {
+      barrier.cond.wait(lock, [&barrier] { return barrier.done; });
+    }
+  }
+}
+
+void IotivityExecutor::getStats(picojson::object& object) {
+  uint64_t completed = m_completed.load();
+
+  object["workers"] = picojson::value(static_cast<double>(m_workers.size()));
+  object["capacity"] = picojson::value(static_cast<double>(m_capacity));
+  object["submitted"] =
+    picojson::value(static_cast<double>(m_submitted.load()));
+  object["rejected"] = picojson::value(static_cast<double>(m_rejected.load()));
+  object["completed"] = picojson::value(static_cast<double>(completed));
+  object["queueDepth"] = picojson::value(static_cast<double>(m_depth.load()));
+  object["maxQueueDepth"] =
+    picojson::value(static_cast<double>(m_maxDepth.load()));
+  object["waitTotalUs"] =
+    picojson::value(static_cast<double>(m_waitTotalUs.load()));
+  object["waitMaxUs"] =
+    picojson::value(static_cast<double>(m_waitMaxUs.load()));
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_EXECUTOR_H_
+#define IOTIVITY_IOTIVITY_EXECUTOR_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/picojson.h"
+
+// Runs command handlers off the Crosswalk messaging thread.
+//
+// Every worker owns a bounded queue. Tasks are routed on a worker by key so
+// that commands for the same resource run in submission order. Exclusive
+// tasks wait until all workers have drained what was queued before them and
+// run alone, for commands that reconfigure the device.
+class IotivityExecutor {
+ public:
+  typedef std::function<void()> Task;
+
+ private:
+  struct Barrier;
+
+  struct Item {
+    Task task;
+    std::shared_ptr<Barrier> barrier;
+    std::chrono::steady_clock::time_point queued;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Item> queue;
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  size_t m_capacity;
+  std::atomic<bool> m_stopping;
+  // Keeps the barrier items of one exclusive task in the same order on
+  // every worker
+  std::mutex m_exclusiveMutex;
+
+  std::atomic<uint64_t> m_submitted;
+  std::atomic<uint64_t> m_rejected;
+  std::atomic<uint64_t> m_completed;
+  std::atomic<uint64_t> m_depth;
+  std::atomic<uint64_t> m_maxDepth;
+  std::atomic<uint64_t> m_waitTotalUs;
+  std::atomic<uint64_t> m_waitMaxUs;
+
+  void run(Worker* worker);
+  void enqueue(Worker* worker, Item& item);
+  void account(const Item& item);
+
+ public:
+  IotivityExecutor(size_t workers, size_t capacity);
+  ~IotivityExecutor();
+
+  // false when the queue of that key is full
+  bool submit(const std::string& key, const Task& task);
+  // Worker the tasks of |key| run on, in submission order
+  size_t route(const std::string& key) const;
+  // false when the queue of |worker| is full
+  bool submitTo(size_t worker, const Task& task);
+  size_t size() const;
+  void submitExclusive(const Task& task);
+
+  void getStats(picojson::object& object);
+};
+
+#endif  // IOTIVITY_IOTIVITY_EXECUTOR_H_
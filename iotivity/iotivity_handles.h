@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_HANDLES_H_
+#define IOTIVITY_IOTIVITY_HANDLES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Generational slot map issuing compact handles for native objects.
+//
+// A handle packs the slot index in its low 32 bits and the slot generation
+// above it. Lookups index the slot array directly and fail once the slot
+// was erased or reused, so a stale handle never reaches a new object.
+// Generations wrap at 21 bits to keep handles exact as JS numbers.
+template <typename T>
+class IotivitySlotMap {
+ public:
+  typedef uint64_t Handle;
+
+  static const Handle kInvalid = 0;
+  static const uint32_t kGenerationMask = (1u << 21) - 1;
+
+ private:
+  struct Slot {
+    uint32_t generation;
+    bool used;
+    T value;
+  };
+
+  std::vector<Slot> m_slots;
+  std::vector<uint32_t> m_free;
+  size_t m_size;
+  std::mutex m_lock;
+
+  static Handle makeHandle(uint32_t index, uint32_t generation) {
+    return (static_cast<Handle>(generation) << 32) | index;
+  }
+
+  // Caller holds m_lock
+  Slot* find(Handle handle) {
+    uint32_t index = static_cast<uint32_t>(handle);
+    uint32_t generation = static_cast<uint32_t>(handle >> 32);
+
+    if (index >= m_slots.size()) {
+      return NULL;
+    }
+
+    Slot& slot = m_slots[index];
+    return (slot.used && slot.generation == generation) ? &slot : NULL;
+  }
+
+ public:
+  IotivitySlotMap() : m_size(0) {}
+
+  Handle insert(const T& value) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    uint32_t index;
+
+    if (m_free.empty()) {
+      index = static_cast<uint32_t>(m_slots.size());
+      m_slots.push_back(Slot());
+      m_slots[index].generation = 0;
+    } else {
+      index = m_free.back();
+      m_free.pop_back();
+    }
+
+    Slot& slot = m_slots[index];
+    // Generation 0 is never issued so no handle equals kInvalid
+    slot.generation = (slot.generation + 1) & kGenerationMask;
+    if (slot.generation == 0) {
+      slot.generation = 1;
+    }
+    slot.used = true;
+    slot.value = value;
+    m_size++;
+    return makeHandle(index, slot.generation);
+  }
+
+  bool get(Handle handle, T& value) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    Slot* slot = find(handle);
+
+    if (slot == NULL) {
+      return false;
+    }
+
+    value = slot->value;
+    return true;
+  }
+
+  // Copies the value out into |value| when given
+  bool erase(Handle handle, T* value = NULL) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    Slot* slot = find(handle);
+
+    if (slot == NULL) {
+      return false;
+    }
+
+    if (value != NULL) {
+      *value = slot->value;
+    }
+
+    slot->used = false;
+    slot->value = T();
+    m_free.push_back(static_cast<uint32_t>(handle));
+    m_size--;
+    return true;
+  }
+
+  // Erases every value |pred| returns true for
+  template <typename Pred>
+  size_t eraseIf(Pred pred) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    size_t erased = 0;
+
+    for (uint32_t i = 0; i < m_slots.size(); i++) {
+      Slot& slot = m_slots[i];
+
+      if (slot.used && pred(slot.value)) {
+        slot.used = false;
+        slot.value = T();
+        m_free.push_back(i);
+        erased++;
+      }
+    }
+
+    m_size -= erased;
+    return erased;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_size;
+  }
+
+  static std::string toString(Handle handle) {
+    return std::to_string(handle);
+  }
+
+  // Rejects ids that are not a plain decimal handle
+  static bool parse(const std::string& id, Handle& handle) {
+    if (id.empty() || id.size() > 20 || id[0] < '1' || id[0] > '9') {
+      return false;
+    }
+
+    char* end = NULL;
+    handle = strtoull(id.c_str(), &end, 10);
+    return *end == '\0';
+  }
+};
+
+#endif  // IOTIVITY_IOTIVITY_HANDLES_H_
@@ -28,93 +28,513 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <string>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 
 #include "iotivity/iotivity_instance.h"
 #include "iotivity/iotivity_device.h"
 #include "iotivity/iotivity_server.h"
 #include "iotivity/iotivity_client.h"
 #include "iotivity/iotivity_resource.h"
+#include "iotivity/iotivity_cbor.h"
+#include "iotivity/iotivity_parser.h"
+#include "iotivity/iotivity_constants.h"
+#include "iotivity/iotivity_trace.h"
 
 std::map<int, OCRepresentation> ResourcesMap;
 
+static const size_t kDefaultWorkers = 2;
+static const size_t kDefaultQueueCapacity = 64;
+
+// Commands on the same resource share a key and so keep their order
+static std::string GetResourceKey(const picojson::value& value) {
+  if (value.contains("id")) {
+    return value.get("id").to_str();
+  }
+
+  if (value.contains("resourceId")) {
+    return value.get("resourceId").to_str();
+  }
+
+  const picojson::value& resource = value.get("OicResource");
+
+  if (resource.is<picojson::object>() && resource.contains("id")) {
+    return resource.get("id").to_str();
+  }
+
+  const picojson::value& resourceInit = value.get("OicResourceInit");
+
+  if (resourceInit.is<picojson::object>() && resourceInit.contains("url")) {
+    return resourceInit.get("url").to_str();
+  }
+
+  const picojson::value& requestEvent = value.get("OicRequestEvent");
+
+  if (requestEvent.is<picojson::object>() && requestEvent.contains("target")) {
+    return requestEvent.get("target").to_str();
+  }
+
+  return EMPTY;
+}
+
+// Device level commands create and destroy the roles, nothing else may run
+static bool IsExclusiveCommand(uint32_t commandId) {
+  switch (commandId) {
+    case CommandHash("configure"):
+    case CommandHash("factoryReset"):
+    case CommandHash("reboot"):
+      return true;
+    default:
+      return false;
+  }
+}
+
 IotivityInstance::IotivityInstance() {
-  pDebugEnv = "1"; //getenv("IOTIVITY_DEBUG");
   m_device = new IotivityDevice(this, NULL);
+  m_device->registerHandlers(&m_dispatcher);
+  m_executor = new IotivityExecutor(
+    GetEnvSize("IOTIVITY_WORKERS", kDefaultWorkers),
+    GetEnvSize("IOTIVITY_QUEUE_SIZE", kDefaultQueueCapacity));
+
+  m_dispatcher.registerHandler(CommandHash("getExecutorStats"),
+    std::bind(&IotivityInstance::handleGetExecutorStats, this,
+              std::placeholders::_1));
+
+  typedef void (IotivityInstance::*InstanceHandler)(const picojson::value&,
+                                                    OCRepresentation*);
+  static const struct {
+    uint32_t id;
+    InstanceHandler handler;
+  } kHandlers[] = {
+    {CommandHash("sendResponse"), &IotivityInstance::handleSendResponse},
+    {CommandHash("sendError"), &IotivityInstance::handleSendError},
+  };
+
+  // Request events only exist when the server role is configured
+  for (auto const& entry : kHandlers) {
+    InstanceHandler handler = entry.handler;
+    m_dispatcher.registerPropertiesHandler(entry.id, "OicRequestEvent",
+      [this, handler](const picojson::value& value,
+                      OCRepresentation* properties) {
+        if (m_device->getServer() == NULL) {
+          m_device->postError("server role not configured",
+                              GetAsyncCallId(value));
+          return;
+        }
+        (this->*handler)(value, properties);
+      });
+  }
 }
 
-IotivityInstance::~IotivityInstance() { delete m_device; }
+IotivityInstance::~IotivityInstance() {
+  // Pending handlers still use the device
+  delete m_executor;
+  delete m_device;
+}
 
 void IotivityInstance::HandleMessage(const char* msg) {
-  if (pDebugEnv != NULL)
-    printf("\n\n[JS==>Native] IotivityInstance::HandleMessage: %s\n", msg);
+  uint64_t receivedUs = IotivityStats::now();
+  size_t size = strlen(msg);
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_MESSAGE_IN, size,
+                 IsCborMessage(msg));
+  m_device->getStats()->messageIn(size);
 
   picojson::value v;
+  ParsedProperties properties;
+  std::vector<ParsedProperties> batch;
+  std::string error;
+
+  if (IsCborMessage(msg)) {
+    ParseCborMessage(msg, m_dispatcher, v, properties, batch, error);
+  } else {
+    ParseMessage(msg, m_dispatcher, v, properties, batch, error);
+  }
+
+  if (!error.empty() || !v.is<picojson::object>()) {
+    IOTIVITY_TRACE(IOTIVITY_TRACE_ERROR, TRACE_MESSAGE_INVALID, size, 0);
+    return;
+  }
+
+  if (v.get("cmd").is<std::string>() &&
+      CommandHash(v.get("cmd").get<std::string>()) == CommandHash("batch")) {
+    picojson::value& commands = v.get<picojson::object>()["commands"];
+
+    if (!commands.is<picojson::array>()) {
+      OIC_LOG_V(ERROR, TAG, "batch without commands\n");
+      return;
+    }
+
+    submitBatch(commands.get<picojson::array>(), batch, receivedUs);
+    return;
+  }
+
+  submitCommand(v, properties, receivedUs);
+}
+
+// Cheap local queries answered on the messaging thread, the reply is
+// {"result": ...} or {"error": "..."}
+void IotivityInstance::HandleSyncMessage(const char* msg) {
+  picojson::value v;
+  picojson::object reply;
   std::string error;
 
   picojson::parse(v, msg, msg + strlen(msg), &error);
-  if (!error.empty()) {
-    std::cout << "Ignoring message.\n";
+
+  if (!error.empty() || !v.is<picojson::object>() ||
+      !v.get("cmd").is<std::string>()) {
+    reply["error"] = picojson::value("invalid sync message");
+    SendSyncReply(picojson::value(reply).serialize().c_str());
+    return;
+  }
+
+  switch (CommandHash(v.get("cmd").get<std::string>())) {
+    case CommandHash("getCachedRepresentation"):
+      syncCachedRepresentation(v, reply);
+      break;
+    case CommandHash("queryResources"):
+      syncQueryResources(v, reply);
+      break;
+    case CommandHash("getServerRepresentation"):
+      syncServerRepresentation(v, reply);
+      break;
+    case CommandHash("getObserverCount"):
+      syncObserverCount(v, reply);
+      break;
+    case CommandHash("getStats"):
+      syncGetStats(v, reply);
+      break;
+    case CommandHash("dumpStats"):
+      syncDumpStats(v, reply);
+      break;
+    case CommandHash("dumpTrace"):
+      syncDumpTrace(v, reply);
+      break;
+    case CommandHash("setTrace"):
+      syncSetTrace(v, reply);
+      break;
+    default:
+      reply["error"] = picojson::value("unknown sync command");
+      break;
+  }
+
+  SendSyncReply(picojson::value(reply).serialize().c_str());
+}
+
+void IotivityInstance::syncCachedRepresentation(const picojson::value& value,
+                                                picojson::object& reply) {
+  IotivityClient* client = m_device->getClient();
+
+  if (client == NULL) {
+    reply["error"] = picojson::value("client role not configured");
     return;
   }
 
-  std::string cmd = v.get("cmd").to_str();
-
-  // Device
-  if (cmd == "configure")
-    m_device->handleConfigure(v);
-  else if (cmd == "factoryReset")
-    m_device->handleFactoryReset(v);
-  else if (cmd == "reboot")
-    m_device->handleReboot(v);
-  // Client
-  else if (cmd == "findResources")
-    m_device->getClient()->handleFindResources(v);
-  else if (cmd == "findDevices")
-    m_device->getClient()->handleFindDevices(v);
-  else if (cmd == "createResource")
-    m_device->getClient()->handleCreateResource(v);
-  else if (cmd == "retrieveResource")
-    m_device->getClient()->handleRetrieveResource(v);
-  else if (cmd == "updateResource")
-    m_device->getClient()->handleUpdateResource(v);
-  else if (cmd == "deleteResource")
-    m_device->getClient()->handleDeleteResource(v);
-  else if (cmd == "startObserving")
-    m_device->getClient()->handleStartObserving(v);
-  else if (cmd == "cancelObserving")
-    m_device->getClient()->handleCancelObserving(v);
-  // Server
-  else if (cmd == "registerResource")
-    m_device->getServer()->handleRegisterResource(v);
-  else if (cmd == "unregisterResource")
-    m_device->getServer()->handleUnregisterResource(v);
-  else if (cmd == "enablePresence")
-    m_device->getServer()->handleEnablePresence(v);
-  else if (cmd == "disablePresence")
-    m_device->getServer()->handleDisablePresence(v);
-  else if (cmd == "notify")
-    m_device->getServer()->handleNotify(v);
-  else if (cmd == "sendResponse")
-    handleSendResponse(v);
-  else if (cmd == "sendError")
-    handleSendError(v);
-  else
-    OIC_LOG_V(ERROR, TAG, std::string("Received unknown message: " + cmd + "\n").c_str());
-
-  return;
-}
-
-void IotivityInstance::handleSendResponse(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleSendResponse: v=%s\n", value.serialize().c_str());
+  IotivityResourceClientPtr resClient =
+    client->getResourceById(value.get("id").to_str());
+  OCRepresentation rep;
+
+  if (resClient == NULL || !resClient->getRepresentation(rep)) {
+    reply["error"] = picojson::value("resource not found");
+    return;
+  }
+
+  picojson::object properties;
+  TranslateOCRepresentationToPicojson(rep, properties);
+  reply["result"] = picojson::value(properties);
+}
+
+void IotivityInstance::syncQueryResources(const picojson::value& value,
+                                          picojson::object& reply) {
+  IotivityClient* client = m_device->getClient();
+
+  if (client == NULL) {
+    reply["error"] = picojson::value("client role not configured");
+    return;
+  }
+
+  std::vector<std::string> ids;
+  client->queryResources(value, ids);
+
+  picojson::array result;
+  result.reserve(ids.size());
+  for (auto const& id : ids) {
+    result.push_back(picojson::value(id));
+  }
+  reply["result"] = picojson::value(result);
+}
+
+void IotivityInstance::syncServerRepresentation(const picojson::value& value,
+                                                picojson::object& reply) {
+  IotivityServer* server = m_device->getServer();
+
+  if (server == NULL) {
+    reply["error"] = picojson::value("server role not configured");
+    return;
+  }
+
+  IotivityResourceServerPtr resServer =
+    server->getResourceById(value.get("id").to_str());
+
+  if (resServer == NULL) {
+    reply["error"] = picojson::value("resource not found");
+    return;
+  }
+
+  picojson::object properties;
+  TranslateOCRepresentationToPicojson(resServer->getRepresentation(),
+                                      properties);
+  reply["result"] = picojson::value(properties);
+}
+
+void IotivityInstance::syncObserverCount(const picojson::value& value,
+                                         picojson::object& reply) {
+  IotivityServer* server = m_device->getServer();
+
+  if (server == NULL) {
+    reply["error"] = picojson::value("server role not configured");
+    return;
+  }
 
+  IotivityResourceServerPtr resServer =
+    server->getResourceById(value.get("id").to_str());
+
+  if (resServer == NULL) {
+    reply["error"] = picojson::value("resource not found");
+    return;
+  }
+
+  reply["result"] =
+    picojson::value(static_cast<double>(resServer->getObserverCount()));
+}
+
+void IotivityInstance::syncGetStats(const picojson::value& value,
+                                    picojson::object& reply) {
+  picojson::object executor;
+  m_executor->getStats(executor);
+
+  picojson::object stats;
+  m_device->getStats()->getStats(stats);
+  stats["executor"] = picojson::value(executor);
+  stats["atoms"] = picojson::value(static_cast<double>(IotivityAtom::count()));
+
+  IotivityClient* client = m_device->getClient();
+  if (client != NULL) {
+    picojson::object cache;
+    client->getDiscoveryCacheStats(cache);
+    stats["discoveryCache"] = picojson::value(cache);
+
+    picojson::object resources;
+    client->getResourceStats(resources);
+    stats["resources"] = picojson::value(resources);
+  }
+  reply["result"] = picojson::value(stats);
+}
+
+void IotivityInstance::syncDumpStats(const picojson::value& value,
+                                     picojson::object& reply) {
+  // Fixed path, the page must not pick what the runtime overwrites
+  std::string path = getUserHome() + "/oic_xwalk_stats.json";
+
+  if (!m_device->getStats()->dump(path)) {
+    reply["error"] = picojson::value("cannot write " + path);
+    return;
+  }
+
+  reply["result"] = picojson::value(path);
+}
+
+void IotivityInstance::syncDumpTrace(const picojson::value& value,
+                                     picojson::object& reply) {
+  std::vector<std::string> lines;
+  TraceDump(lines);
+
+  picojson::array result;
+  for (size_t i = 0; i < lines.size(); i++) {
+    result.push_back(picojson::value(lines[i]));
+  }
+
+  reply["result"] = picojson::value(result);
+}
+
+void IotivityInstance::syncSetTrace(const picojson::value& value,
+                                    picojson::object& reply) {
+  bool enabled = value.get("enabled").evaluate_as_boolean();
+  TraceSetEnabled(enabled);
+  reply["result"] = picojson::value(enabled);
+}
+
+struct IotivityInstance::Command {
+  std::string key;
+  uint32_t commandId;
+  double asyncCallId;
+  picojson::value value;
+  ParsedProperties properties;
+};
+
+// Keeps what the commands of a batch post while they run, the last task
+// to release it answers with one envelope
+struct IotivityInstance::BatchReply {
+  IotivityDevice* device;
+  std::mutex mutex;
+  IotivityDevice::CapturedEvents events;
+
+  explicit BatchReply(IotivityDevice* device) : device(device) {}
+  ~BatchReply() { device->postEvents(events); }
+
+  void run(const std::function<void()>& task) {
+    IotivityDevice::CapturedEvents captured;
+    device->captureEvents(&captured);
+    task();
+    device->captureEvents(NULL);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& event : captured) {
+      events.push_back(std::make_pair(std::string(), event.second));
+      events.back().first.swap(event.first);
+    }
+  }
+};
+
+IotivityInstance::CommandPtr IotivityInstance::makeCommand(
+    picojson::value& v, const ParsedProperties& properties,
+    uint64_t receivedUs) {
+  if (!v.is<picojson::object>() || !v.get("cmd").is<std::string>()) {
+    OIC_LOG_V(ERROR, TAG, std::string("Received unknown message: " +
+      v.serialize() + "\n").c_str());
+    return CommandPtr();
+  }
+
+  CommandPtr command = std::make_shared<Command>();
+  command->value.swap(v);
+  command->properties = properties;
+  command->key = GetResourceKey(command->value);
+
+  const std::string& cmd = command->value.get("cmd").get<std::string>();
+  command->commandId = CommandHash(cmd);
+  command->asyncCallId = GetAsyncCallId(command->value);
+
+  // Registered before the task runs, it may complete right away
+  if (command->value.get("asyncCallId").is<double>()) {
+    m_device->getStats()->commandReceived(cmd, command->asyncCallId,
+                                          receivedUs);
+  }
+
+  return command;
+}
+
+void IotivityInstance::runCommand(const Command& command) {
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_COMMAND_START, command.commandId,
+                 command.asyncCallId);
+
+  if (!m_dispatcher.dispatch(command.commandId, command.value,
+                             command.properties.get())) {
+    IOTIVITY_TRACE(IOTIVITY_TRACE_ERROR, TRACE_COMMAND_UNKNOWN,
+                   command.commandId, command.asyncCallId);
+    return;
+  }
+
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_COMMAND_END, command.commandId,
+                 command.asyncCallId);
+}
+
+void IotivityInstance::submitCommand(picojson::value& v,
+                                     const ParsedProperties& properties,
+                                     uint64_t receivedUs) {
+  // Queues copy tasks around, they share the command instead
+  CommandPtr command = makeCommand(v, properties, receivedUs);
+
+  if (!command) {
+    return;
+  }
+
+  IotivityExecutor::Task task = [this, command]() { runCommand(*command); };
+
+  if (IsExclusiveCommand(command->commandId)) {
+    m_executor->submitExclusive(task);
+  } else if (!m_executor->submit(command->key, task)) {
+    IOTIVITY_TRACE(IOTIVITY_TRACE_ERROR, TRACE_COMMAND_REJECTED,
+                   command->commandId, command->asyncCallId);
+    m_device->postError("command queue full", command->asyncCallId);
+  }
+}
+
+void IotivityInstance::submitBatch(
+    picojson::array& commands,
+    const std::vector<ParsedProperties>& properties, uint64_t receivedUs) {
+  std::shared_ptr<BatchReply> reply =
+    std::make_shared<BatchReply>(m_device);
+  std::vector<CommandGroup> groups(m_executor->size());
+
+  // Commands of a worker share one queue slot and keep the order of the
+  // batch, an exclusive command is a barrier between two rounds of groups
+  for (size_t i = 0; i < commands.size(); i++) {
+    CommandPtr command = makeCommand(commands[i],
+      i < properties.size() ? properties[i] : ParsedProperties(),
+      receivedUs);
+
+    if (!command) {
+      continue;
+    }
+
+    if (!IsExclusiveCommand(command->commandId)) {
+      groups[m_executor->route(command->key)].push_back(command);
+      continue;
+    }
+
+    submitGroups(groups, reply);
+    m_executor->submitExclusive([this, command, reply]() {
+      reply->run([this, command]() { runCommand(*command); });
+    });
+  }
+
+  submitGroups(groups, reply);
+}
+
+void IotivityInstance::submitGroups(std::vector<CommandGroup>& groups,
+                                    const std::shared_ptr<BatchReply>& reply) {
+  for (size_t worker = 0; worker < groups.size(); worker++) {
+    if (groups[worker].empty()) {
+      continue;
+    }
+
+    std::shared_ptr<CommandGroup> group = std::make_shared<CommandGroup>();
+    group->swap(groups[worker]);
+
+    IotivityExecutor::Task task = [this, group, reply]() {
+      reply->run([this, group]() {
+        for (auto& command : *group) runCommand(*command);
+      });
+    };
+
+    if (m_executor->submitTo(worker, task)) {
+      continue;
+    }
+
+    reply->run([this, group]() {
+      for (auto& command : *group) {
+        IOTIVITY_TRACE(IOTIVITY_TRACE_ERROR, TRACE_COMMAND_REJECTED,
+                       command->commandId, command->asyncCallId);
+        m_device->postError("command queue full", command->asyncCallId);
+      }
+    });
+  }
+}
+
+void IotivityInstance::handleSendResponse(const picojson::value& value,
+                                          OCRepresentation* properties) {
   double async_call_id = value.get("asyncCallId").get<double>();
 
   picojson::value resource = value.get("resource");
   picojson::value OicRequestEvent = value.get("OicRequestEvent");
   IotivityRequestEvent iotivityRequestEvent;
-  iotivityRequestEvent.deserialize(OicRequestEvent);
+  iotivityRequestEvent.m_device = m_device;
+  iotivityRequestEvent.deserialize(OicRequestEvent, properties);
   OCStackResult result = iotivityRequestEvent.sendResponse();
+  m_device->getStats()->requestAnswered(iotivityRequestEvent.m_requestId,
+                                        OC_STACK_OK != result);
 
   if (OC_STACK_OK != result) {
     m_device->postError("sendResponse failed", async_call_id);
@@ -124,15 +544,17 @@ void IotivityInstance::handleSendResponse(const picojson::value& value) {
   m_device->postResult("sendResponseCompleted", async_call_id);
 }
 
-void IotivityInstance::handleSendError(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleSendError: v=%s\n", value.serialize().c_str());
-
+void IotivityInstance::handleSendError(const picojson::value& value,
+                                       OCRepresentation* properties) {
   double async_call_id = value.get("asyncCallId").get<double>();
   std::string errorMsg = value.get("error").to_str();
   picojson::value OicRequestEvent = value.get("OicRequestEvent");
   IotivityRequestEvent iotivityRequestEvent;
-  iotivityRequestEvent.deserialize(OicRequestEvent);
+  iotivityRequestEvent.m_device = m_device;
+  iotivityRequestEvent.deserialize(OicRequestEvent, properties);
   OCStackResult result = iotivityRequestEvent.sendError();
+  m_device->getStats()->requestAnswered(iotivityRequestEvent.m_requestId,
+                                        true);
 
   if (OC_STACK_OK != result) {
     m_device->postError("sendError failed", async_call_id);
@@ -141,3 +563,16 @@ void IotivityInstance::handleSendError(const picojson::value& value) {
 
   m_device->postResult("sendResponseCompleted", async_call_id);
 }
+
+void IotivityInstance::handleGetExecutorStats(const picojson::value& value) {
+  double async_call_id = value.get("asyncCallId").get<double>();
+
+  picojson::object stats;
+  m_executor->getStats(stats);
+
+  picojson::value::object object;
+  object["cmd"] = picojson::value("getExecutorStatsCompleted");
+  object["asyncCallId"] = picojson::value(async_call_id);
+  object["stats"] = picojson::value(stats);
+  m_device->PostMessage(picojson::value(object));
+}
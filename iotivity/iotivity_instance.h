@@ -30,12 +30,17 @@
 #ifndef IOTIVITY_IOTIVITY_INSTANCE_H_
 #define IOTIVITY_IOTIVITY_INSTANCE_H_
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "common/extension.h"
 #include "common/picojson.h"
 #include "iotivity/iotivity_tools.h"
 #include "iotivity/iotivity_device.h"
+#include "iotivity/iotivity_dispatcher.h"
+#include "iotivity/iotivity_executor.h"
+#include "iotivity/iotivity_parser.h"
 
 class IotivityInstance : public common::Instance {
  public:
@@ -43,11 +48,50 @@ class IotivityInstance : public common::Instance {
   ~IotivityInstance();
 
   void HandleMessage(const char* msg);
-  void handleSendResponse(const picojson::value& value);
-  void handleSendError(const picojson::value& value);
+  void HandleSyncMessage(const char* msg);
+  void handleSendResponse(const picojson::value& value,
+                          OCRepresentation* properties);
+  void handleSendError(const picojson::value& value,
+                       OCRepresentation* properties);
+  void handleGetExecutorStats(const picojson::value& value);
+
+  void syncCachedRepresentation(const picojson::value& value,
+                                picojson::object& reply);
+  void syncQueryResources(const picojson::value& value,
+                          picojson::object& reply);
+  void syncServerRepresentation(const picojson::value& value,
+                                picojson::object& reply);
+  void syncObserverCount(const picojson::value& value,
+                         picojson::object& reply);
+  void syncGetStats(const picojson::value& value, picojson::object& reply);
+  void syncDumpTrace(const picojson::value& value, picojson::object& reply);
+  void syncSetTrace(const picojson::value& value, picojson::object& reply);
+  void syncDumpStats(const picojson::value& value, picojson::object& reply);
 
  private:
+  struct Command;
+  struct BatchReply;
+  typedef std::shared_ptr<Command> CommandPtr;
+  typedef std::vector<CommandPtr> CommandGroup;
+
   IotivityDevice* m_device;
+  IotivityDispatcher m_dispatcher;
+  IotivityExecutor* m_executor;
+
+  // Takes the contents of v, the task keeps them without a copy. NULL for a
+  // message that is not a command
+  CommandPtr makeCommand(picojson::value& v,
+                         const ParsedProperties& properties,
+                         uint64_t receivedUs);
+  void runCommand(const Command& command);
+  void submitCommand(picojson::value& v,
+                     const ParsedProperties& properties, uint64_t receivedUs);
+  // One task per worker and one reply envelope for the whole batch
+  void submitBatch(picojson::array& commands,
+                   const std::vector<ParsedProperties>& properties,
+                   uint64_t receivedUs);
+  void submitGroups(std::vector<CommandGroup>& groups,
+                    const std::shared_ptr<BatchReply>& reply);
 };
 
 #endif  // IOTIVITY_IOTIVITY_INSTANCE_H_
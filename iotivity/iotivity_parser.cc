@@ -0,0 +1,637 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_parser.h"
+
+#include <string.h>
+
+#include "iotivity/iotivity_cbor.h"
+
+namespace {
+
+typedef picojson::input<const char*> Input;
+
+// Collects one attribute value, arrays are typed after their first item
+class OCAttributeParseContext : public picojson::deny_parse_context {
+ private:
+  enum BaseType { NONE, BOOLEAN, INTEGER, STRING, OBJECT };
+
+  OCRepresentation& m_rep;
+  const std::string& m_key;
+  bool m_isArray;
+  BaseType m_baseType;
+  std::vector<bool> m_bools;
+  std::vector<int> m_ints;
+  std::vector<std::string> m_strings;
+  std::vector<OCRepresentation> m_reps;
+
+  // A single array item
+  class ItemParseContext : public picojson::deny_parse_context {
+   private:
+    OCAttributeParseContext& m_attr;
+
+   public:
+    explicit ItemParseContext(OCAttributeParseContext& attr) : m_attr(attr) {}
+
+    bool set_null() { return true; }
+
+    bool set_bool(bool b) {
+      if (m_attr.m_baseType == NONE) m_attr.m_baseType = BOOLEAN;
+      if (m_attr.m_baseType == BOOLEAN) m_attr.m_bools.push_back(b);
+      return true;
+    }
+
+    bool set_number(double f) {
+      if (m_attr.m_baseType == NONE) m_attr.m_baseType = INTEGER;
+      if (m_attr.m_baseType == INTEGER) {
+        m_attr.m_ints.push_back(static_cast<int>(f));
+      }
+      return true;
+    }
+
+    bool parse_string(Input& in) {
+      std::string str;
+      if (!picojson::_parse_string(str, in)) return false;
+      if (m_attr.m_baseType == NONE) m_attr.m_baseType = STRING;
+      if (m_attr.m_baseType == STRING) {
+        m_attr.m_strings.push_back(std::string());
+        m_attr.m_strings.back().swap(str);
+      }
+      return true;
+    }
+
+    bool parse_array_start() { return true; }
+
+    bool parse_array_item(Input& in, size_t) {
+      // nested arrays are not mapped
+      picojson::null_parse_context ctx;
+      return picojson::_parse(ctx, in);
+    }
+
+    bool parse_object_start();
+    bool parse_object_item(Input& in, const std::string& key);
+  };
+
+ public:
+  OCAttributeParseContext(OCRepresentation& rep, const std::string& key)
+    : m_rep(rep), m_key(key), m_isArray(false), m_baseType(NONE) {}
+
+  bool set_null() { return true; }
+
+  bool set_bool(bool b) {
+    m_rep[m_key] = b;
+    return true;
+  }
+
+  bool set_number(double f) {
+    if (m_key == "temperature") {
+      m_rep[m_key] = f;
+    } else {
+      m_rep[m_key] = static_cast<int>(f);
+    }
+    return true;
+  }
+
+  bool parse_string(Input& in) {
+    std::string str;
+    if (!picojson::_parse_string(str, in)) return false;
+    m_rep[m_key] = str;
+    return true;
+  }
+
+  bool parse_array_start() {
+    m_isArray = true;
+    return true;
+  }
+
+  bool parse_array_item(Input& in, size_t) {
+    ItemParseContext ctx(*this);
+    return picojson::_parse(ctx, in);
+  }
+
+  // nested objects are not mapped, as in PicojsonPropsToOCRep
+  bool parse_object_start() { return true; }
+
+  bool parse_object_item(Input& in, const std::string&) {
+    picojson::null_parse_context ctx;
+    return picojson::_parse(ctx, in);
+  }
+
+  // Arrays are only complete once picojson returns from them
+  void commit() {
+    if (!m_isArray) return;
+
+    switch (m_baseType) {
+      case BOOLEAN: m_rep[m_key] = m_bools; break;
+      case INTEGER: m_rep[m_key] = m_ints; break;
+      case STRING: m_rep[m_key] = m_strings; break;
+      case OBJECT: m_rep[m_key] = m_reps; break;
+      case NONE: break;
+    }
+  }
+};
+
+// Maps every key of a JSON object on an OCRepresentation attribute
+class OCRepParseContext : public picojson::deny_parse_context {
+ private:
+  OCRepresentation& m_rep;
+
+ public:
+  explicit OCRepParseContext(OCRepresentation& rep) : m_rep(rep) {}
+
+  // Anything but an object leaves the representation empty
+  bool set_null() { return true; }
+  bool set_bool(bool) { return true; }
+  bool set_number(double) { return true; }
+
+  bool parse_string(Input& in) {
+    picojson::null_parse_context ctx;
+    return ctx.parse_string(in);
+  }
+
+  bool parse_array_start() { return true; }
+
+  bool parse_array_item(Input& in, size_t) {
+    picojson::null_parse_context ctx;
+    return picojson::_parse(ctx, in);
+  }
+
+  bool parse_object_start() { return true; }
+
+  bool parse_object_item(Input& in, const std::string& key) {
+    OCAttributeParseContext ctx(m_rep, key);
+    if (!picojson::_parse(ctx, in)) return false;
+    ctx.commit();
+    return true;
+  }
+};
+
+bool OCAttributeParseContext::ItemParseContext::parse_object_start() {
+  if (m_attr.m_baseType == NONE) m_attr.m_baseType = OBJECT;
+  if (m_attr.m_baseType == OBJECT) m_attr.m_reps.push_back(OCRepresentation());
+  return true;
+}
+
+bool OCAttributeParseContext::ItemParseContext::parse_object_item(
+  Input& in, const std::string& key) {
+  if (m_attr.m_baseType != OBJECT) {
+    picojson::null_parse_context ctx;
+    return picojson::_parse(ctx, in);
+  }
+
+  OCRepParseContext ctx(m_attr.m_reps.back());
+  return ctx.parse_object_item(in, key);
+}
+
+// Builds the message envelope, diverting the payload "properties"
+class MessageParseContext : public picojson::default_parse_context {
+ private:
+  const IotivityDispatcher& m_dispatcher;
+  ParsedProperties& m_properties;
+  // Only set on a top level message, batches do not nest
+  std::vector<ParsedProperties>* m_batch;
+  const std::string* m_payload;
+  bool m_isBatch;
+  int m_depth;
+  bool m_hasCmd;
+
+  // Object and array values met before "cmd", parsed again once it tells
+  // whether one of them is the payload
+  struct Deferred {
+    picojson::value* item;
+    const std::string* key;
+    const char* begin;
+    const char* end;
+  };
+  std::vector<Deferred> m_deferred;
+
+  bool parseDeferred();
+
+  // One message context per "commands" item of a batch
+  class BatchParseContext : public picojson::default_parse_context {
+   private:
+    const IotivityDispatcher& m_dispatcher;
+    std::vector<ParsedProperties>& m_batch;
+
+   public:
+    BatchParseContext(picojson::value* out,
+                      const IotivityDispatcher& dispatcher,
+                      std::vector<ParsedProperties>& batch)
+      : picojson::default_parse_context(out), m_dispatcher(dispatcher),
+        m_batch(batch) {}
+
+    bool parse_array_item(Input& in, size_t) {
+      picojson::array& a = out_->get<picojson::array>();
+      a.push_back(picojson::value());
+      m_batch.push_back(ParsedProperties());
+      MessageParseContext ctx(&a.back(), m_dispatcher, m_batch.back(), NULL,
+                              NULL, 0);
+      return picojson::_parse(ctx, in);
+    }
+  };
+
+ public:
+  MessageParseContext(picojson::value* out,
+                      const IotivityDispatcher& dispatcher,
+                      ParsedProperties& properties,
+                      std::vector<ParsedProperties>* batch,
+                      const std::string* payload, int depth)
+    : picojson::default_parse_context(out), m_dispatcher(dispatcher),
+      m_properties(properties), m_batch(batch), m_payload(payload),
+      m_isBatch(false), m_depth(depth), m_hasCmd(false) {}
+
+  bool parse_object_item(Input& in, const std::string& key) {
+    picojson::object& o = out_->get<picojson::object>();
+    picojson::value& item = o[key];
+
+    if (m_depth == 0 && key == "cmd") {
+      picojson::default_parse_context ctx(&item);
+      if (!picojson::_parse(ctx, in)) return false;
+      if (item.is<std::string>()) {
+        uint32_t commandId = CommandHash(item.get<std::string>());
+        m_payload = m_dispatcher.propertiesPayload(commandId);
+        m_isBatch = m_batch != NULL && commandId == CommandHash("batch");
+      }
+      m_hasCmd = true;
+      return parseDeferred();
+    }
+
+    // The value starts right after the colon the caller consumed
+    if (m_depth == 0 && !m_hasCmd) {
+      const char* begin = in.cur();
+      picojson::default_parse_context ctx(&item);
+      if (!picojson::_parse(ctx, in)) return false;
+      if (item.is<picojson::object>() || item.is<picojson::array>()) {
+        Deferred deferred = {&item, &o.find(key)->first, begin, in.cur()};
+        m_deferred.push_back(deferred);
+      }
+      return true;
+    }
+
+    if (m_depth == 0 && m_isBatch && key == "commands") {
+      BatchParseContext ctx(&item, m_dispatcher, *m_batch);
+      return picojson::_parse(ctx, in);
+    }
+
+    if (m_depth == 0 && m_payload != NULL && key == *m_payload) {
+      MessageParseContext ctx(&item, m_dispatcher, m_properties, NULL,
+                              m_payload, 1);
+      return picojson::_parse(ctx, in);
+    }
+
+    if (m_depth == 1 && key == "properties" && !m_properties) {
+      m_properties = std::make_shared<OCRepresentation>();
+      OCRepParseContext ctx(*m_properties);
+      return picojson::_parse(ctx, in);
+    }
+
+    picojson::default_parse_context ctx(&item);
+    return picojson::_parse(ctx, in);
+  }
+};
+
+// Senders put "cmd" first, a payload before it is parsed twice
+bool MessageParseContext::parseDeferred() {
+  for (auto const &deferred : m_deferred) {
+    bool commands = m_isBatch && *deferred.key == "commands";
+    bool payload = m_payload != NULL && *deferred.key == *m_payload;
+
+    if (!commands && !payload) {
+      continue;
+    }
+
+    Input in(deferred.begin, deferred.end);
+    *deferred.item = picojson::value();
+
+    if (commands) {
+      BatchParseContext ctx(deferred.item, m_dispatcher, *m_batch);
+      if (!picojson::_parse(ctx, in)) return false;
+    } else {
+      MessageParseContext ctx(deferred.item, m_dispatcher, m_properties,
+                              NULL, m_payload, 1);
+      if (!picojson::_parse(ctx, in)) return false;
+    }
+  }
+
+  m_deferred.clear();
+  return true;
+}
+
+// CBOR counterparts of the parse contexts, with the same typing rules
+const unsigned kMaxCborDepth = 64;
+
+bool SkipCbor(CborReader& reader) {
+  picojson::value skipped;
+  return reader.readValue(skipped, 0);
+}
+
+bool ReadCborRep(CborReader& reader, OCRepresentation& rep, unsigned depth);
+
+bool ReadCborAttribute(CborReader& reader, OCRepresentation& rep,
+                       const std::string& key, unsigned depth) {
+  uint8_t major;
+  if (!reader.peek(major)) return false;
+
+  // nested objects are not mapped, as in PicojsonPropsToOCRep
+  if (major == CBOR_MAP) {
+    return SkipCbor(reader);
+  }
+
+  if (major != CBOR_ARRAY) {
+    picojson::value value;
+    if (!reader.readValue(value, depth)) return false;
+
+    if (value.is<bool>()) {
+      rep[key] = value.get<bool>();
+    } else if (value.is<double>() && key == "temperature") {
+      rep[key] = value.get<double>();
+    } else if (value.is<double>()) {
+      rep[key] = static_cast<int>(value.get<double>());
+    } else if (value.is<std::string>()) {
+      rep[key] = value.get<std::string>();
+    }
+    return true;
+  }
+
+  // Arrays are typed after their first item
+  enum { NONE, BOOLEAN, INTEGER, STRING, OBJECT } baseType = NONE;
+  std::vector<bool> bools;
+  std::vector<int> ints;
+  std::vector<std::string> strings;
+  std::vector<OCRepresentation> reps;
+
+  uint64_t count;
+  bool indefinite;
+  if (!reader.readLength(count, indefinite)) return false;
+
+  for (uint64_t i = 0; indefinite ? !reader.readBreak() : i < count; i++) {
+    uint8_t itemMajor;
+    if (!reader.peek(itemMajor)) return false;
+
+    if (itemMajor == CBOR_MAP) {
+      if (baseType == NONE) baseType = OBJECT;
+      if (baseType != OBJECT) {
+        if (!SkipCbor(reader)) return false;
+        continue;
+      }
+      reps.push_back(OCRepresentation());
+      if (!ReadCborRep(reader, reps.back(), depth + 1)) return false;
+      continue;
+    }
+
+    picojson::value item;
+    if (!reader.readValue(item, depth + 1)) return false;
+
+    // nested arrays are not mapped
+    if (item.is<bool>()) {
+      if (baseType == NONE) baseType = BOOLEAN;
+      if (baseType == BOOLEAN) bools.push_back(item.get<bool>());
+    } else if (item.is<double>()) {
+      if (baseType == NONE) baseType = INTEGER;
+      if (baseType == INTEGER) {
+        ints.push_back(static_cast<int>(item.get<double>()));
+      }
+    } else if (item.is<std::string>()) {
+      if (baseType == NONE) baseType = STRING;
+      if (baseType == STRING) {
+        strings.push_back(std::string());
+        strings.back().swap(item.get<std::string>());
+      }
+    }
+  }
+
+  switch (baseType) {
+    case BOOLEAN: rep[key] = bools; break;
+    case INTEGER: rep[key] = ints; break;
+    case STRING: rep[key] = strings; break;
+    case OBJECT: rep[key] = reps; break;
+    case NONE: break;
+  }
+  return true;
+}
+
+// Anything but a map leaves the representation empty
+bool ReadCborRep(CborReader& reader, OCRepresentation& rep, unsigned depth) {
+  uint8_t major;
+  if (depth > kMaxCborDepth || !reader.peek(major)) return false;
+
+  if (major != CBOR_MAP) {
+    return SkipCbor(reader);
+  }
+
+  uint64_t count;
+  bool indefinite;
+  if (!reader.readLength(count, indefinite)) return false;
+
+  for (uint64_t i = 0; indefinite ? !reader.readBreak() : i < count; i++) {
+    picojson::value key;
+    if (!reader.readValue(key, depth) || !key.is<std::string>()) return false;
+    if (!ReadCborAttribute(reader, rep, key.get<std::string>(), depth)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReadCborMessage(CborReader& reader, const IotivityDispatcher& dispatcher,
+                     picojson::value& value, ParsedProperties& properties,
+                     std::vector<ParsedProperties>* batch);
+
+// The payload object of a command, its "properties" go to |properties|
+bool ReadCborPayload(CborReader& reader, picojson::value& value,
+                     ParsedProperties& properties) {
+  uint8_t major;
+  if (!reader.peek(major)) return false;
+
+  if (major != CBOR_MAP) {
+    return reader.readValue(value, 1);
+  }
+
+  uint64_t count;
+  bool indefinite;
+  if (!reader.readLength(count, indefinite)) return false;
+
+  value = picojson::value(picojson::object_type, false);
+  picojson::object& o = value.get<picojson::object>();
+
+  for (uint64_t i = 0; indefinite ? !reader.readBreak() : i < count; i++) {
+    picojson::value key;
+    if (!reader.readValue(key, 1) || !key.is<std::string>()) return false;
+    picojson::value& item = o[key.get<std::string>()];
+
+    if (key.get<std::string>() == "properties" && !properties) {
+      properties = std::make_shared<OCRepresentation>();
+      if (!ReadCborRep(reader, *properties, 2)) return false;
+    } else if (!reader.readValue(item, 2)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReadCborBatch(CborReader& reader, const IotivityDispatcher& dispatcher,
+                   picojson::value& value,
+                   std::vector<ParsedProperties>& batch) {
+  uint8_t major;
+  if (!reader.peek(major)) return false;
+
+  if (major != CBOR_ARRAY) {
+    return reader.readValue(value, 1);
+  }
+
+  uint64_t count;
+  bool indefinite;
+  if (!reader.readLength(count, indefinite)) return false;
+
+  value = picojson::value(picojson::array_type, false);
+  picojson::array& a = value.get<picojson::array>();
+
+  for (uint64_t i = 0; indefinite ? !reader.readBreak() : i < count; i++) {
+    a.push_back(picojson::value());
+    batch.push_back(ParsedProperties());
+    if (!ReadCborMessage(reader, dispatcher, a.back(), batch.back(), NULL)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A payload met before "cmd" is read again from its position once known
+bool ReadCborMessage(CborReader& reader, const IotivityDispatcher& dispatcher,
+                     picojson::value& value, ParsedProperties& properties,
+                     std::vector<ParsedProperties>* batch) {
+  uint8_t major;
+  if (!reader.peek(major)) return false;
+
+  if (major != CBOR_MAP) {
+    return reader.readValue(value, 0);
+  }
+
+  uint64_t count;
+  bool indefinite;
+  if (!reader.readLength(count, indefinite)) return false;
+
+  value = picojson::value(picojson::object_type, false);
+  picojson::object& o = value.get<picojson::object>();
+  const std::string* payload = NULL;
+  bool isBatch = false;
+  bool hasCmd = false;
+  std::vector<std::pair<std::string, size_t> > deferred;
+
+  for (uint64_t i = 0; indefinite ? !reader.readBreak() : i < count; i++) {
+    picojson::value key;
+    if (!reader.readValue(key, 1) || !key.is<std::string>()) return false;
+    const std::string& name = key.get<std::string>();
+    picojson::value& item = o[name];
+
+    if (name == "cmd") {
+      if (!reader.readValue(item, 1)) return false;
+      if (item.is<std::string>()) {
+        uint32_t commandId = CommandHash(item.get<std::string>());
+        payload = dispatcher.propertiesPayload(commandId);
+        isBatch = batch != NULL && commandId == CommandHash("batch");
+      }
+      hasCmd = true;
+
+      size_t end = reader.position();
+      for (auto const &entry : deferred) {
+        picojson::value& again = o[entry.first];
+        reader.seek(entry.second);
+        again = picojson::value();
+
+        if (isBatch && entry.first == "commands") {
+          if (!ReadCborBatch(reader, dispatcher, again, *batch)) return false;
+        } else if (payload != NULL && entry.first == *payload) {
+          if (!ReadCborPayload(reader, again, properties)) return false;
+        }
+      }
+      reader.seek(end);
+      deferred.clear();
+      continue;
+    }
+
+    if (!hasCmd) {
+      size_t begin = reader.position();
+      if (!reader.readValue(item, 1)) return false;
+      if (item.is<picojson::object>() || item.is<picojson::array>()) {
+        deferred.push_back(std::make_pair(name, begin));
+      }
+      continue;
+    }
+
+    if (isBatch && name == "commands") {
+      if (!ReadCborBatch(reader, dispatcher, item, *batch)) return false;
+    } else if (payload != NULL && name == *payload) {
+      if (!ReadCborPayload(reader, item, properties)) return false;
+    } else if (!reader.readValue(item, 1)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ParseMessage(const char* msg, const IotivityDispatcher& dispatcher,
+                  picojson::value& value, ParsedProperties& properties,
+                  std::vector<ParsedProperties>& batch, std::string& error) {
+  properties.reset();
+  batch.clear();
+
+  MessageParseContext ctx(&value, dispatcher, properties, &batch, NULL, 0);
+  picojson::_parse(ctx, msg, msg + strlen(msg), &error);
+
+  return error.empty();
+}
+
+bool ParseCborMessage(const char* msg, const IotivityDispatcher& dispatcher,
+                      picojson::value& value, ParsedProperties& properties,
+                      std::vector<ParsedProperties>& batch,
+                      std::string& error) {
+  properties.reset();
+  batch.clear();
+
+  std::string cbor;
+  if (!IsCborMessage(msg) ||
+      !Base64Decode(msg + strlen(kCborMessagePrefix), cbor)) {
+    error = "invalid CBOR message";
+    return false;
+  }
+
+  CborReader reader(reinterpret_cast<const uint8_t*>(cbor.data()),
+                    cbor.size());
+
+  if (!ReadCborMessage(reader, dispatcher, value, properties, &batch) ||
+      !reader.atEnd()) {
+    error = "invalid CBOR message";
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_PARSER_H_
+#define IOTIVITY_IOTIVITY_PARSER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "iotivity/iotivity_tools.h"
+#include "iotivity/iotivity_dispatcher.h"
+
+// Payload properties built while parsing, NULL when the handler has to
+// convert them from the picojson tree
+typedef std::shared_ptr<OCRepresentation> ParsedProperties;
+
+// One pass parse of an inbound JSON message.
+//
+// The envelope is parsed into |value|. When the dispatcher has a properties
+// handler for the message "cmd", the "properties" object of its payload is
+// built straight into |properties| (and left null in |value|), following the
+// same typing rules as PicojsonPropsToOCRep. The JS side sends "cmd" first;
+// a payload seen before it is parsed again once "cmd" is known. For a
+// "batch" message the same is done for every item of "commands", |batch|
+// then holds one entry per item.
+bool ParseMessage(const char* msg, const IotivityDispatcher& dispatcher,
+                  picojson::value& value, ParsedProperties& properties,
+                  std::vector<ParsedProperties>& batch, std::string& error);
+
+// Same for a base64 CBOR message, the payload "properties" map is decoded
+// straight into |properties| without a picojson tree.
+bool ParseCborMessage(const char* msg, const IotivityDispatcher& dispatcher,
+                      picojson::value& value, ParsedProperties& properties,
+                      std::vector<ParsedProperties>& batch,
+                      std::string& error);
+
+#endif  // IOTIVITY_IOTIVITY_PARSER_H_
@@ -29,9 +29,10 @@
  */
 #include "iotivity/iotivity_resource.h"
 #include "common/extension.h"
+#include "iotivity/iotivity_server.h"
+#include "iotivity/iotivity_trace.h"
 
 IotivityResourceInit::IotivityResourceInit() {
-  m_url = "";
   m_deviceId = "";
   m_connectionMode = "";
   m_discoverable = false;
@@ -39,13 +40,15 @@ IotivityResourceInit::IotivityResourceInit() {
   m_isSecure = false;
 }
 
-IotivityResourceInit::IotivityResourceInit(const picojson::value& value) {
-  deserialize(value);
+IotivityResourceInit::IotivityResourceInit(const picojson::value& value,
+                                           OCRepresentation* properties) {
+  deserialize(value, properties);
 }
 
 IotivityResourceInit::~IotivityResourceInit() {}
 
-void IotivityResourceInit::deserialize(const picojson::value& value) {
+void IotivityResourceInit::deserialize(const picojson::value& value,
+                                       OCRepresentation* properties) {
   OIC_LOG_V(DEBUG, TAG, ">>IotivityResourceInit::deserialize\n");
 
   m_url = value.get("url").to_str();
@@ -54,37 +57,37 @@ void IotivityResourceInit::deserialize(const picojson::value& value) {
   m_discoverable = value.get("discoverable").get<bool>();
   m_observable = value.get("observable").get<bool>();
   m_isSecure = false;
-  m_resourceTypeName = "";
-  m_resourceInterface = "";
+  m_resourceTypeName = IotivityAtom();
+  m_resourceInterface = IotivityAtom();
   m_resourceProperty = 0;
 
-  picojson::array resourceTypes =
+  const picojson::array& resourceTypes =
     value.get("resourceTypes").get<picojson::array>();
 
-  for (picojson::array::iterator iter = resourceTypes.begin();
+  for (picojson::array::const_iterator iter = resourceTypes.begin();
        iter != resourceTypes.end(); ++iter) {
     OIC_LOG_V(DEBUG, TAG, "array resourceTypes value=%s\n",
       (*iter).get<string>().c_str());
-    if (m_resourceTypeName == "") {
-      m_resourceTypeName = (*iter).get<string>();
-    }
-
     m_resourceTypeNameArray.push_back((*iter).get<string>());
+    if (m_resourceTypeName.empty()) {
+      m_resourceTypeName = m_resourceTypeNameArray.back();
+    }
   }
 
-  picojson::array interfaces = value.get("interfaces").get<picojson::array>();
+  const picojson::array& interfaces =
+    value.get("interfaces").get<picojson::array>();
 
-  for (picojson::array::iterator iter = interfaces.begin();
+  for (picojson::array::const_iterator iter = interfaces.begin();
        iter != interfaces.end(); ++iter) {
     OIC_LOG_V(DEBUG, TAG, "array interfaces value=%s\n",
       (*iter).get<string>().c_str());
-    if (m_resourceInterface == "") {
-      m_resourceInterface = (*iter).get<string>();
-    }
     m_resourceInterfaceArray.push_back((*iter).get<string>());
+    if (m_resourceInterface.empty()) {
+      m_resourceInterface = m_resourceInterfaceArray.back();
+    }
   }
 
-  if (m_resourceInterface == "") { m_resourceInterface = DEFAULT_INTERFACE; }
+  if (m_resourceInterface.empty()) { m_resourceInterface = DEFAULT_INTERFACE; }
 
   if (m_discoverable) { m_resourceProperty |= OC_DISCOVERABLE; }
 
@@ -98,12 +101,17 @@ void IotivityResourceInit::deserialize(const picojson::value& value) {
     m_url.c_str(), m_resourceTypeName.c_str(), m_resourceInterface.c_str(),
             m_resourceProperty);
 
-  picojson::value properties = value.get("properties");
-  picojson::object& propertiesobject = properties.get<picojson::object>();
-  OIC_LOG_V(DEBUG, TAG, "properties: size=%d\n", propertiesobject.size());
+  // Built by ParseMessage in the same pass, the command drops it afterwards
+  if (properties != NULL) {
+    m_resourceRep = std::move(*properties);
+  } else if (value.get("properties").is<picojson::object>()) {
+    const picojson::object& propertiesobject =
+      value.get("properties").get<picojson::object>();
+    OIC_LOG_V(DEBUG, TAG, "properties: size=%d\n", propertiesobject.size());
+    PicojsonPropsToOCRep(m_resourceRep, propertiesobject);
+  }
 
   m_resourceRep.setUri(m_url);
-  PicojsonPropsToOCRep(m_resourceRep, propertiesobject);
   OIC_LOG_V(DEBUG, TAG, "<<IotivityResourceInit::deserialize\n");
 }
 
@@ -115,12 +123,16 @@ void IotivityResourceInit::serialize(picojson::object& object) {
   object["observable"] = picojson::value(m_observable);
   picojson::array resourceTypes;
 
-  CopyInto(m_resourceTypeNameArray, resourceTypes);
+  for (auto const& resourceType : m_resourceTypeNameArray) {
+    resourceTypes.push_back(picojson::value(resourceType.str()));
+  }
 
   object["resourceTypes"] = picojson::value(resourceTypes);
   picojson::array interfaces;
 
-  CopyInto(m_resourceInterfaceArray, interfaces);
+  for (auto const& resourceInterface : m_resourceInterfaceArray) {
+    interfaces.push_back(picojson::value(resourceInterface.str()));
+  }
 
   object["interfaces"] = picojson::value(interfaces);
   picojson::object properties;
@@ -128,6 +140,25 @@ void IotivityResourceInit::serialize(picojson::object& object) {
   object["properties"] = picojson::value(properties);
 }
 
+void IotivityResourceInit::serialize(IotivityMessageWriter& writer) {
+  writer.key("url");
+  writer.value(m_url);
+  writer.key("deviceId");
+  writer.value(m_deviceId);
+  writer.key("connectionMode");
+  writer.value(m_connectionMode);
+  writer.key("discoverable");
+  writer.value(m_discoverable);
+  writer.key("observable");
+  writer.value(m_observable);
+  writer.key("resourceTypes");
+  writer.stringArray(m_resourceTypeNameArray);
+  writer.key("interfaces");
+  writer.stringArray(m_resourceInterfaceArray);
+  writer.key("properties");
+  writer.representation(m_resourceRep);
+}
+
 IotivityResourceServer::IotivityResourceServer(
   IotivityDevice* device, IotivityResourceInit* oicResource)
   : m_device(device) {
@@ -148,26 +179,46 @@ IotivityResourceServer::~IotivityResourceServer() {
 }
 
 OCRepresentation IotivityResourceServer::getRepresentation() {
+  std::lock_guard<std::mutex> lock(m_lock);
   return m_oicResourceInit->m_resourceRep;
 }
 
-ObservationIds& IotivityResourceServer::getObserversList() {
+// A copy, the entity handler changes the list on stack threads
+ObservationIds IotivityResourceServer::getObserversList() {
+  std::lock_guard<std::mutex> lock(m_lock);
   return m_interestedObservers;
 }
 
+size_t IotivityResourceServer::getObserverCount() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_interestedObservers.size();
+}
+
 OCEntityHandlerResult IotivityResourceServer::entityHandlerCallback(
   std::shared_ptr<OCResourceRequest> request) {
   OIC_LOG_V(DEBUG, TAG, "\n\n[Remote Client==>] entityHandlerCallback:\n");
+  uint64_t startUs = IotivityStats::now();
 
   OCEntityHandlerResult ehResult = OC_EH_ERROR;
-  picojson::value::object object;
 
   if (request) {
     ehResult = OC_EH_OK;
+    IotivityServer* server = m_device->getServer();
+
+    if (server == NULL) {
+      return OC_EH_ERROR;
+    }
+
     IotivityRequestEvent iotivityRequestEvent;
     iotivityRequestEvent.deserialize(request);
-    iotivityRequestEvent.m_resourceRepTarget = m_oicResourceInit->m_resourceRep;
+    iotivityRequestEvent.m_requestId =
+      server->addRequest(request->getRequestHandle(), m_resourceHandle);
+    iotivityRequestEvent.m_source =
+      std::to_string(iotivityRequestEvent.m_requestId);
+    iotivityRequestEvent.m_target = m_idfull;
     int requestFlag = request->getRequestHandlerFlag();
+    std::unique_lock<std::mutex> lock(m_lock);
+    iotivityRequestEvent.m_resourceRepTarget = m_oicResourceInit->m_resourceRep;
 
     if (requestFlag & RequestHandlerFlag::ObserverFlag) {
       OIC_LOG_V(DEBUG, TAG, "postEntityHandler:ObserverFlag\n");
@@ -193,12 +244,20 @@ OCEntityHandlerResult IotivityResourceServer::entityHandlerCallback(
                              iotivityRequestEvent.m_updatedPropertyNames);
     }
 
-    object["cmd"] = picojson::value("entityHandler");
-    picojson::object OicRequestEvent;
-    iotivityRequestEvent.serialize(OicRequestEvent);
-    object["OicRequestEvent"] = picojson::value(OicRequestEvent);
-    picojson::value value(object);
-    m_device->PostMessage(value.serialize().c_str());
+    lock.unlock();
+
+    IotivityMessageWriter writer(m_device->isCborMessaging());
+    writer.beginObject();
+    writer.key("cmd");
+    writer.value("entityHandler");
+    writer.key("OicRequestEvent");
+    writer.beginObject();
+    iotivityRequestEvent.serialize(writer);
+    writer.endObject();
+    writer.endObject();
+    m_device->PostMessage(writer);
+    m_device->getStats()->entityHandled(iotivityRequestEvent.m_requestId,
+                                        startUs);
   } else {
     OIC_LOG_V(ERROR, TAG, "entityHandlerCallback: Request invalid");
   }
@@ -207,6 +266,7 @@ OCEntityHandlerResult IotivityResourceServer::entityHandlerCallback(
 }
 
 void IotivityResourceServer::serialize(picojson::object& object) {
+  std::lock_guard<std::mutex> lock(m_lock);
   object["id"] = picojson::value(m_idfull);
   picojson::object properties;
   m_oicResourceInit->serialize(properties);
@@ -219,10 +279,12 @@ OCStackResult IotivityResourceServer::registerResource() {
     std::bind(&IotivityResourceServer::entityHandlerCallback, this,
               std::placeholders::_1);
 
+  std::string uri = m_oicResourceInit->m_url;
+
   result = OCPlatform::registerResource(
-             m_resourceHandle, m_oicResourceInit->m_url,
-             m_oicResourceInit->m_resourceTypeName,
-             m_oicResourceInit->m_resourceInterface, resourceCallback,
+             m_resourceHandle, uri,
+             m_oicResourceInit->m_resourceTypeName.str(),
+             m_oicResourceInit->m_resourceInterface.str(), resourceCallback,
              m_oicResourceInit->m_resourceProperty);
 
   if (OC_STACK_OK != result) {
@@ -230,15 +292,11 @@ OCStackResult IotivityResourceServer::registerResource() {
     return result;
   }
 
-  // TODO(aphao) should retrieve host IP + uri instead of int:
-  // Missing C/C++ API to retrieve server resource's host url
-  m_idfull = std::to_string(getResourceHandleToInt());
-
   unsigned int size = m_oicResourceInit->m_resourceTypeNameArray.size();
 
   for (unsigned int i = 1; i < size; i++) {
-    std::string resourceTypeName =
-      m_oicResourceInit->m_resourceTypeNameArray[i];
+    const std::string& resourceTypeName =
+      m_oicResourceInit->m_resourceTypeNameArray[i].str();
 
     OIC_LOG_V(DEBUG, TAG, "bindTypeToResource=%s\n", resourceTypeName.c_str());
 
@@ -254,8 +312,8 @@ OCStackResult IotivityResourceServer::registerResource() {
 
   int iSize = m_oicResourceInit->m_resourceInterfaceArray.size();
   for (int i = 1; i < iSize; i++) {
-    std::string resourceInterface =
-      m_oicResourceInit->m_resourceInterfaceArray[i];
+    const std::string& resourceInterface =
+      m_oicResourceInit->m_resourceInterfaceArray[i].str();
 
     OIC_LOG_V(DEBUG, TAG, "bindInterfaceToResource=%s\n",
       resourceInterface.c_str());
@@ -272,16 +330,30 @@ OCStackResult IotivityResourceServer::registerResource() {
   return result;
 }
 
-int IotivityResourceServer::getResourceHandleToInt() {
-  int* p = reinterpret_cast<int*>(m_resourceHandle);
-  int pint = reinterpret_cast<int>(p);
-  return pint;
+OCStackResult IotivityResourceServer::unregisterResource() {
+  OCStackResult result = OCPlatform::unregisterResource(m_resourceHandle);
+
+  if (OC_STACK_OK == result) {
+    m_resourceHandle = 0;
+  }
+
+  return result;
+}
+
+OCResourceHandle IotivityResourceServer::getResourceHandle() {
+  return m_resourceHandle;
 }
 
 std::string IotivityResourceServer::getResourceId() { return m_idfull; }
 
+// Server resources are named by their handle in IotivityServer, the stack
+// has no API to retrieve their host url
+void IotivityResourceServer::setResourceId(const std::string& id) {
+  m_idfull = id;
+}
+
 IotivityResourceClient::IotivityResourceClient(IotivityDevice* device)
-  : m_device(device) {
+  : m_device(device), m_inFlight(0), m_observing(false) {
   m_ocResourcePtr = NULL;
   m_oicResourceInit = new IotivityResourceInit();
 }
@@ -299,10 +371,10 @@ const std::shared_ptr<OCResource> IotivityResourceClient::getSharedPtr() {
 
 void IotivityResourceClient::setSharedPtr(
   std::shared_ptr<OCResource> sharePtr) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_jsonObject.clear();
+  m_cborObject.clear();
   m_ocResourcePtr = sharePtr;
-  int* p = reinterpret_cast<int*>(sharePtr.get());
-  int pint = reinterpret_cast<int>(p);
-  m_id = pint;
   m_oicResourceInit->m_url = sharePtr->uri();
   m_oicResourceInit->m_deviceId = sharePtr->sid();
   m_oicResourceInit->m_connectionMode = "default";
@@ -313,49 +385,138 @@ void IotivityResourceClient::setSharedPtr(
   m_sid = sharePtr->sid();
   m_host = sharePtr->host();
   m_idfull = m_host + sharePtr->uri();
+  m_oicResourceInit->m_resourceTypeNameArray =
+    ToAtoms(sharePtr->getResourceTypes());
+  m_oicResourceInit->m_resourceInterfaceArray =
+    ToAtoms(sharePtr->getResourceInterfaces());
+}
 
-  for (auto& resourceTypes : sharePtr->getResourceTypes()) {
-    m_oicResourceInit->m_resourceTypeNameArray.push_back(resourceTypes.c_str());
-  }
+std::string IotivityResourceClient::getResourceId() { return m_idfull; }
+
+std::string IotivityResourceClient::getDeviceId() { return m_sid; }
+
+// Resources constructed from a saved host and uri do not know their device
+void IotivityResourceClient::setDeviceId(const std::string& deviceId) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_jsonObject.clear();
+  m_cborObject.clear();
+  m_sid = deviceId;
+  m_oicResourceInit->m_deviceId = deviceId;
+}
+
+std::string IotivityResourceClient::getHost() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_host;
+}
+
+std::vector<IotivityAtom> IotivityResourceClient::getResourceTypes() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_oicResourceInit->m_resourceTypeNameArray;
+}
+
+std::vector<IotivityAtom> IotivityResourceClient::getInterfaces() {
+  std::lock_guard<std::mutex> lock(m_lock);
+  return m_oicResourceInit->m_resourceInterfaceArray;
+}
 
-  for (auto& resourceInterfaces : sharePtr->getResourceInterfaces()) {
-    m_oicResourceInit->m_resourceInterfaceArray.push_back(
-      resourceInterfaces.c_str());
+void IotivityResourceClient::setRepresentation(const OCRepresentation& rep) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  m_jsonObject.clear();
+  m_cborObject.clear();
+  m_oicResourceInit->m_resourceRep = rep;
+}
+
+// Last representation received from the remote server
+bool IotivityResourceClient::getRepresentation(OCRepresentation& rep) {
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  if (m_oicResourceInit == NULL) {
+    return false;
   }
+
+  rep = m_oicResourceInit->m_resourceRep;
+  return true;
 }
 
-int IotivityResourceClient::getResourceHandleToInt() { return m_id; }
+bool IotivityResourceClient::isEvictable() {
+  return m_inFlight == 0 && !m_observing;
+}
 
-std::string IotivityResourceClient::getResourceId() { return m_idfull; }
+// Rough footprint of the resource: the objects, their own strings, the
+// cached encodings and the last representation
+size_t IotivityResourceClient::getMemoryUsage() {
+  static const size_t kAttributeBytes = 64;
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  return sizeof(*this) + sizeof(IotivityResourceInit) + sizeof(OCResource) +
+         m_idfull.capacity() + m_sid.capacity() + m_host.capacity() +
+         m_oicResourceInit->m_url.capacity() + m_jsonObject.capacity() +
+         m_cborObject.capacity() +
+         (m_oicResourceInit->m_resourceTypeNameArray.capacity() +
+          m_oicResourceInit->m_resourceInterfaceArray.capacity()) *
+           sizeof(IotivityAtom) +
+         m_oicResourceInit->m_resourceRep.numberOfAttributes() *
+           kAttributeBytes;
+}
 
-void IotivityResourceClient::serialize(picojson::object& object) {
-  object["id"] = picojson::value(getResourceId());
+void IotivityResourceClient::serialize(IotivityMessageWriter& writer) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  serializeLocked(writer);
+}
 
-  picojson::object properties;
-  m_oicResourceInit->serialize(properties);
-  object["OicResourceInit"] = picojson::value(properties);
+void IotivityResourceClient::serializeLocked(IotivityMessageWriter& writer) {
+  writer.key("id");
+  writer.value(m_idfull);
+  writer.key("OicResourceInit");
+  writer.beginObject();
+  m_oicResourceInit->serialize(writer);
+  writer.endObject();
+}
+
+// Discoveries list the same resources again and again, each is encoded
+// once until it changes
+void IotivityResourceClient::serializeObject(IotivityMessageWriter& writer) {
+  std::lock_guard<std::mutex> lock(m_lock);
+  std::string& encoded = writer.isCbor() ? m_cborObject : m_jsonObject;
+
+  if (encoded.empty()) {
+    IotivityMessageWriter object(writer.isCbor(), encoded);
+    object.beginObject();
+    serializeLocked(object);
+    object.endObject();
+  }
+
+  writer.raw(encoded);
 }
 
 void IotivityResourceClient::onPut(const HeaderOptions& headerOptions,
                                    const OCRepresentation& rep, const int eCode,
                                    double asyncCallId) {
   OIC_LOG_V(DEBUG, TAG, "onPut: eCode=%d, asyncCallId=%f\n", eCode, asyncCallId);
+  m_inFlight--;
 
-  picojson::value::object object;
-  object["cmd"] = picojson::value("updateResourceCompleted");
-  object["eCode"] = picojson::value(static_cast<double>(eCode));
-  object["asyncCallId"] = picojson::value(static_cast<double>(asyncCallId));
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("updateResourceCompleted");
+  writer.key("eCode");
+  writer.value(static_cast<double>(eCode));
+  writer.key("asyncCallId");
+  writer.value(asyncCallId);
 
   if (eCode == SUCCESS_RESPONSE) {
-    PrintfOcRepresentation(rep);
-    m_oicResourceInit->m_resourceRep = rep;
-    serialize(object);
+    IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_IN,
+                   rep.numberOfAttributes(), eCode);
+    setRepresentation(rep);
+    serialize(writer);
   } else {
     OIC_LOG_V(ERROR, TAG, "onPut was unsuccessful\n");
   }
 
-  picojson::value value(object);
-  m_device->PostMessage(value.serialize().c_str());
+  writer.endObject();
+  m_device->getStats()->commandCompleted("updateResourceCompleted", asyncCallId,
+                                         eCode != SUCCESS_RESPONSE);
+  m_device->PostMessage(writer);
 }
 
 void IotivityResourceClient::onGet(const HeaderOptions& headerOptions,
@@ -363,58 +524,79 @@ void IotivityResourceClient::onGet(const HeaderOptions& headerOptions,
                                    const int eCode,
                                    double asyncCallId) {
   OIC_LOG_V(DEBUG, TAG, "onGet: eCode=%d, %f\n", eCode, asyncCallId);
+  m_inFlight--;
 
-  picojson::value::object object;
-  object["cmd"] = picojson::value("retrieveResourceCompleted");
-  object["eCode"] = picojson::value(static_cast<double>(eCode));
-
-  object["asyncCallId"] = picojson::value(static_cast<double>(asyncCallId));
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("retrieveResourceCompleted");
+  writer.key("eCode");
+  writer.value(static_cast<double>(eCode));
+  writer.key("asyncCallId");
+  writer.value(asyncCallId);
 
   if (eCode == SUCCESS_RESPONSE) {
-    PrintfOcRepresentation(rep);
-    m_oicResourceInit->m_resourceRep = rep;
-    serialize(object);
+    IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_IN,
+                   rep.numberOfAttributes(), eCode);
+    setRepresentation(rep);
+    serialize(writer);
   } else {
     OIC_LOG_V(ERROR, TAG, "onGet was unsuccessful\n");
   }
 
-  picojson::value value(object);
-  m_device->PostMessage(value.serialize().c_str());
+  writer.endObject();
+  m_device->getStats()->commandCompleted("retrieveResourceCompleted",
+                                         asyncCallId,
+                                         eCode != SUCCESS_RESPONSE);
+  m_device->PostMessage(writer);
 }
 
 void IotivityResourceClient::onPost(const HeaderOptions& headerOptions,
                                     const OCRepresentation& rep,
                                     const int eCode, double asyncCallId) {
   OIC_LOG_V(DEBUG, TAG, "onPost: eCode=%d, %f\n", eCode, asyncCallId);
+  m_inFlight--;
 
-  picojson::value::object object;
-  object["cmd"] = picojson::value("createResourceCompleted");
-  object["eCode"] = picojson::value(static_cast<double>(eCode));
-  object["asyncCallId"] = picojson::value(static_cast<double>(asyncCallId));
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("createResourceCompleted");
+  writer.key("eCode");
+  writer.value(static_cast<double>(eCode));
+  writer.key("asyncCallId");
+  writer.value(asyncCallId);
 
   if (eCode == SUCCESS_RESPONSE) {
-    PrintfOcRepresentation(rep);
-    m_oicResourceInit->m_resourceRep = rep;
-    serialize(object);
+    IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_IN,
+                   rep.numberOfAttributes(), eCode);
+    setRepresentation(rep);
+    serialize(writer);
   } else {
     OIC_LOG_V(ERROR, TAG, "onPost was unsuccessful\n");
   }
 
-  picojson::value value(object);
-  m_device->PostMessage(value.serialize().c_str());
+  writer.endObject();
+  m_device->getStats()->commandCompleted("createResourceCompleted", asyncCallId,
+                                         eCode != SUCCESS_RESPONSE);
+  m_device->PostMessage(writer);
 }
 
 void IotivityResourceClient::onStartObserving(double asyncCallId) {
   OIC_LOG_V(DEBUG, TAG, "onStartObserving: %f\n", asyncCallId);
 
-  picojson::value::object object;
-  object["cmd"] = picojson::value("startObservingCompleted");
-  object["eCode"] = picojson::value(static_cast<double>(0));
-  object["asyncCallId"] = picojson::value(static_cast<double>(asyncCallId));
-
-  serialize(object);
-  picojson::value value(object);
-  m_device->PostMessage(value.serialize().c_str());
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("startObservingCompleted");
+  writer.key("eCode");
+  writer.value(static_cast<double>(0));
+  writer.key("asyncCallId");
+  writer.value(asyncCallId);
+  serialize(writer);
+  writer.endObject();
+  m_device->getStats()->commandCompleted("startObservingCompleted",
+                                         asyncCallId, false);
+  m_device->PostMessage(writer);
 }
 
 void IotivityResourceClient::onObserve(const HeaderOptions headerOptions,
@@ -426,45 +608,48 @@ void IotivityResourceClient::onObserve(const HeaderOptions headerOptions,
     "\n\n[Remote Server==>] "
     "onObserve: sequenceNumber=%d, eCode=%d, %f\n",
     sequenceNumber, eCode, asyncCallId);
-  picojson::value::object object;
-  object["cmd"] = picojson::value("onObserve");
-  object["eCode"] = picojson::value(static_cast<double>(eCode));
-  object["asyncCallId"] = picojson::value(static_cast<double>(asyncCallId));
+  IotivityMessageWriter writer(m_device->isCborMessaging());
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("onObserve");
+  writer.key("eCode");
+  writer.value(static_cast<double>(eCode));
+  writer.key("asyncCallId");
+  writer.value(asyncCallId);
+  writer.key("type");
 
   if (sequenceNumber == OC_OBSERVE_REGISTER) {
-    object["type"] = picojson::value("register");
+    writer.value("register");
   } else if (sequenceNumber == OC_OBSERVE_DEREGISTER) {
-    object["type"] = picojson::value("deregister");
+    writer.value("deregister");
   } else {
-    object["type"] = picojson::value("update");
+    writer.value("update");
   }
 
   if (eCode == OC_STACK_OK) {
-    PrintfOcRepresentation(rep);
-    m_oicResourceInit->m_resourceRep = rep;
-
-    std::vector<std::string> updatedPropertyNames;
+    IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_IN,
+                   rep.numberOfAttributes(), eCode);
+    setRepresentation(rep);
 
+    writer.key("updatedPropertyNames");
+    writer.beginArray();
     for (auto& cur : rep) {
-      std::string attrname = cur.attrname();
-      updatedPropertyNames.push_back(attrname);
+      writer.value(cur.attrname());
     }
-
-    picojson::array updatedPropertyNamesArray;
-    CopyInto(updatedPropertyNames, updatedPropertyNamesArray);
-    object["updatedPropertyNames"] = picojson::value(updatedPropertyNamesArray);
-    serialize(object);
+    writer.endArray();
+    serialize(writer);
   } else {
     OIC_LOG_V(ERROR, TAG, "\n\n[Remote Server==>] onObserve: error\n");
   }
 
-  picojson::value value(object);
-  m_device->PostMessage(value.serialize().c_str());
+  writer.endObject();
+  m_device->PostMessage(writer);
 }
 
 void IotivityResourceClient::onDelete(const HeaderOptions& headerOptions,
                                       const int eCode, double asyncCallId) {
   OIC_LOG_V(DEBUG, TAG, "onDelete: eCode=%d, %f\n", eCode, asyncCallId);
+  m_inFlight--;
 
   picojson::value::object object;
   object["cmd"] = picojson::value("deleteResourceCompleted");
@@ -476,7 +661,7 @@ void IotivityResourceClient::onDelete(const HeaderOptions& headerOptions,
   }
 
   picojson::value value(object);
-  m_device->PostMessage(value.serialize().c_str());
+  m_device->PostMessage(value);
 }
 
 OCStackResult IotivityResourceClient::createResource(
@@ -488,11 +673,14 @@ OCStackResult IotivityResourceClient::createResource(
   if (m_ocResourcePtr == NULL) { return result; }
 
   PostCallback attributeHandler =
-    std::bind(&IotivityResourceClient::onPost, this, std::placeholders::_1,
-              std::placeholders::_2, std::placeholders::_3, asyncCallId);
+    std::bind(&IotivityResourceClient::onPost, shared_from_this(),
+              std::placeholders::_1, std::placeholders::_2,
+              std::placeholders::_3, asyncCallId);
+  m_inFlight++;
   result = m_ocResourcePtr->post(oicResourceInit.m_resourceRep,
                                  QueryParamsMap(), attributeHandler);
   if (OC_STACK_OK != result) {
+    m_inFlight--;
     OIC_LOG_V(ERROR, TAG, "post/create was unsuccessful\n");
     return result;
   }
@@ -508,10 +696,13 @@ OCStackResult IotivityResourceClient::retrieveResource(double asyncCallId) {
   if (m_ocResourcePtr == NULL) { return result; }
 
   GetCallback attributeHandler =
-    std::bind(&IotivityResourceClient::onGet, this, std::placeholders::_1,
-              std::placeholders::_2, std::placeholders::_3, asyncCallId);
+    std::bind(&IotivityResourceClient::onGet, shared_from_this(),
+              std::placeholders::_1, std::placeholders::_2,
+              std::placeholders::_3, asyncCallId);
+  m_inFlight++;
   result = m_ocResourcePtr->get(QueryParamsMap(), attributeHandler);
   if (OC_STACK_OK != result) {
+    m_inFlight--;
     OIC_LOG_V(ERROR, TAG, "get was unsuccessful\n");
     return result;
   }
@@ -533,25 +724,32 @@ OCStackResult IotivityResourceClient::updateResource(
 
   if (m_ocResourcePtr == NULL) { return result; }
 
-  PrintfOcRepresentation(representation);
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_OUT,
+                 representation.numberOfAttributes(), asyncCallId);
 
   if (doPost) {
     PostCallback attributeHandler =
-      std::bind(&IotivityResourceClient::onPost, this, std::placeholders::_1,
-                std::placeholders::_2, std::placeholders::_3, asyncCallId);
+      std::bind(&IotivityResourceClient::onPost, shared_from_this(),
+                std::placeholders::_1, std::placeholders::_2,
+                std::placeholders::_3, asyncCallId);
+    m_inFlight++;
     result =
       m_ocResourcePtr->post(representation, QueryParamsMap(), attributeHandler);
     if (OC_STACK_OK != result) {
+      m_inFlight--;
       OIC_LOG_V(ERROR, TAG, "update was unsuccessful\n");
       return result;
     }
   } else {
     PutCallback attributeHandler =
-      std::bind(&IotivityResourceClient::onPut, this, std::placeholders::_1,
-                std::placeholders::_2, std::placeholders::_3, asyncCallId);
+      std::bind(&IotivityResourceClient::onPut, shared_from_this(),
+                std::placeholders::_1, std::placeholders::_2,
+                std::placeholders::_3, asyncCallId);
+    m_inFlight++;
     result =
       m_ocResourcePtr->put(representation, QueryParamsMap(), attributeHandler);
     if (OC_STACK_OK != result) {
+      m_inFlight--;
       OIC_LOG_V(ERROR, TAG, "update was unsuccessful\n");
       return result;
     }
@@ -568,11 +766,13 @@ OCStackResult IotivityResourceClient::deleteResource(double asyncCallId) {
   if (m_ocResourcePtr == NULL) { return result; }
 
   DeleteCallback deleteHandler =
-    std::bind(&IotivityResourceClient::onDelete, this, std::placeholders::_1,
-              std::placeholders::_2, asyncCallId);
+    std::bind(&IotivityResourceClient::onDelete, shared_from_this(),
+              std::placeholders::_1, std::placeholders::_2, asyncCallId);
+  m_inFlight++;
   result = m_ocResourcePtr->deleteResource(deleteHandler);
 
   if (OC_STACK_OK != result) {
+    m_inFlight--;
     OIC_LOG_V(ERROR, TAG, "delete was unsuccessful\n");
     return result;
   }
@@ -588,9 +788,10 @@ OCStackResult IotivityResourceClient::startObserving(double asyncCallId) {
   if (m_ocResourcePtr == NULL) { return result; }
 
   ObserveCallback observeHandler =
-    std::bind(&IotivityResourceClient::onObserve, this, std::placeholders::_1,
-              std::placeholders::_2, std::placeholders::_3,
-              std::placeholders::_4, asyncCallId);
+    std::bind(&IotivityResourceClient::onObserve, shared_from_this(),
+              std::placeholders::_1, std::placeholders::_2,
+              std::placeholders::_3, std::placeholders::_4,
+              asyncCallId);
 
   result = m_ocResourcePtr->observe(ObserveType::Observe, QueryParamsMap(),
                                     observeHandler);
@@ -599,6 +800,7 @@ OCStackResult IotivityResourceClient::startObserving(double asyncCallId) {
     return result;
   }
 
+  m_observing = true;
   onStartObserving(asyncCallId);
 
   return result;
@@ -616,10 +818,12 @@ OCStackResult IotivityResourceClient::cancelObserving(double asyncCallId) {
     return result;
   }
 
+  m_observing = false;
   return result;
 }
 
-IotivityRequestEvent::IotivityRequestEvent() {}
+IotivityRequestEvent::IotivityRequestEvent()
+  : m_device(NULL), m_requestId(0) {}
 
 IotivityRequestEvent::~IotivityRequestEvent() {}
 
@@ -627,11 +831,9 @@ void IotivityRequestEvent::deserialize(
   std::shared_ptr<OCResourceRequest> request) {
   std::string requestType = request->getRequestType();
   int requestFlag = request->getRequestHandlerFlag();
-  int requestHandle = (int)request->getRequestHandle();  // NOLINT
 
   OIC_LOG_V(DEBUG, TAG, "Deserialize: requestType=%s\n", requestType.c_str());
   OIC_LOG_V(DEBUG, TAG, "Deserialize: requestFlag=0x%x\n", requestFlag);
-  OIC_LOG_V(DEBUG, TAG, "Deserialize: requestHandle=0x%x\n", requestHandle);
 
   if (requestFlag & RequestHandlerFlag::RequestFlag) {
     if (requestType == "GET") {
@@ -647,7 +849,8 @@ void IotivityRequestEvent::deserialize(
     }
 
     m_resourceRep = request->getResourceRepresentation();
-    PrintfOcRepresentation(m_resourceRep);
+    IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REQUEST, requestFlag,
+                   m_resourceRep.numberOfAttributes());
 
     for (auto& cur : m_resourceRep) {
       std::string attrname = cur.attrname();
@@ -672,84 +875,87 @@ void IotivityRequestEvent::deserialize(
         it->getOptionID(), it->getOptionData().c_str());
     }
   }
-
-  m_requestId = requestHandle;
-  m_source = std::to_string(requestHandle);
-  m_target = std::to_string((int)(request->getResourceHandle()));  // NOLINT
 }
 
-void IotivityRequestEvent::deserialize(const picojson::value& value) {
-  m_requestId = static_cast<int>(value.get("requestId").get<double>());
+void IotivityRequestEvent::deserialize(const picojson::value& value,
+                                       OCRepresentation* properties) {
+  m_requestId = static_cast<uint64_t>(value.get("requestId").get<double>());
   m_type = value.get("type").to_str();
   m_source = value.get("source").to_str();
   m_target = value.get("target").to_str();
-  picojson::value properties = value.get("properties");
-  picojson::object& propertiesobject = properties.get<picojson::object>();
 
   OIC_LOG_V(DEBUG, TAG, "IotivityRequestEvent::deserialize from JSON\n");
+
+  // Already parsed by ParseMessage, "uri" is kept as an attribute there too
+  if (properties != NULL) {
+    m_resourceRep = *properties;
+    std::string uri;
+    if (m_resourceRep.getValue("uri", uri)) {
+      m_resourceRep.setUri(uri);
+    }
+    return;
+  }
+
+  const picojson::value& props = value.get("properties");
+  const picojson::object& propertiesobject = props.get<picojson::object>();
+
   OIC_LOG_V(DEBUG, TAG, "properties: size=%d\n", propertiesobject.size());
 
-  m_resourceRep.setUri(properties.get("uri").to_str());
+  m_resourceRep.setUri(props.get("uri").to_str());
 
   PicojsonPropsToOCRep(m_resourceRep, propertiesobject);
 }
 
-void IotivityRequestEvent::serialize(picojson::object& object) {
-  object["type"] = picojson::value(m_type);
-  object["requestId"] = picojson::value(static_cast<double>(m_requestId));
-  object["source"] = picojson::value(m_source);
-  object["target"] = picojson::value(m_target);
+void IotivityRequestEvent::serialize(IotivityMessageWriter& writer) {
+  writer.key("type");
+  writer.value(m_type);
+  writer.key("requestId");
+  writer.value(static_cast<double>(m_requestId));
+  writer.key("source");
+  writer.value(m_source);
+  writer.key("target");
+  writer.value(m_target);
 
   OIC_LOG_V(DEBUG, TAG, "IotivityRequestEvent::serialize to JSON\n");
 
   if ((m_type == "create") || (m_type == "update")) {
-    picojson::object properties;
-    TranslateOCRepresentationToPicojson(m_resourceRep, properties);
-    object["properties"] = picojson::value(properties);
-
-    PrintfOcRepresentation(m_resourceRep);
+    writer.key("properties");
+    writer.representation(m_resourceRep);
   }
 
   if ((m_type == "retrieve") || (m_type == "observe")) {
-    picojson::object properties;
-    TranslateOCRepresentationToPicojson(m_resourceRepTarget, properties);
-    object["properties"] = picojson::value(properties);
-
-    PrintfOcRepresentation(m_resourceRepTarget);
+    writer.key("properties");
+    writer.representation(m_resourceRepTarget);
   }
 
   if (m_type == "update") {
-    picojson::array updatedPropertyNamesArray;
-
-    CopyInto(m_updatedPropertyNames, updatedPropertyNamesArray);
-    object["updatedPropertyNames"] = picojson::value(updatedPropertyNamesArray);
+    writer.key("updatedPropertyNames");
+    writer.stringArray(m_updatedPropertyNames);
   }
 
-  picojson::array queryOptionsArray;
-  if (!m_queries.empty()) {
-    for (auto it : m_queries) {
-      picojson::object object;
-      OIC_LOG_V(DEBUG, TAG, "Queries: key=%s, value=%s\n", it.first.c_str(),
-                it.second.c_str());
-      object[it.first.c_str()] = picojson::value(it.second);
-      queryOptionsArray.push_back(picojson::value(object));
-    }
+  for (auto it : m_queries) {
+    OIC_LOG_V(DEBUG, TAG, "Queries: key=%s, value=%s\n", it.first.c_str(),
+              it.second.c_str());
   }
 
-  picojson::array headerOptionsArray;
+  for (auto it = m_headerOptions.begin(); it != m_headerOptions.end(); ++it) {
+    OIC_LOG_V(DEBUG, TAG, "HeaderOptions: ID=%d, value=%s\n",
+      it->getOptionID(), it->getOptionData().c_str());
+  }
+}
 
-  if (!m_headerOptions.empty()) {
-    picojson::object object;
+// Stale or already answered requests are not in the server any more
+static bool TakeRequest(IotivityDevice* device, uint64_t requestId,
+                        IotivityServer::PendingRequest& pending) {
+  IotivityServer* server = device ? device->getServer() : NULL;
 
-    for (auto it = m_headerOptions.begin(); it != m_headerOptions.end(); ++it) {
-      picojson::object object;
-      OIC_LOG_V(DEBUG, TAG, "HeaderOptions: ID=%d, value=%s\n",
-        it->getOptionID(), it->getOptionData().c_str());
-      object[std::to_string(it->getOptionID()).c_str()] =
-        picojson::value(it->getOptionData());
-      headerOptionsArray.push_back(picojson::value(object));
-    }
+  if (server == NULL || !server->takeRequest(requestId, pending)) {
+    OIC_LOG_V(ERROR, TAG, "IotivityRequestEvent: unknown request %s\n",
+              std::to_string(requestId).c_str());
+    return false;
   }
+
+  return true;
 }
 
 OCStackResult IotivityRequestEvent::sendResponse() {
@@ -757,11 +963,15 @@ OCStackResult IotivityRequestEvent::sendResponse() {
     m_type.c_str());
 
   OCStackResult result = OC_STACK_ERROR;
-  auto pResponse = std::make_shared<OC::OCResourceResponse>();
-  pResponse->setRequestHandle(reinterpret_cast<void*>(m_requestId));
+  IotivityServer::PendingRequest pending;
+
+  if (!TakeRequest(m_device, m_requestId, pending)) {
+    return result;
+  }
 
-  int targetId = atoi(m_target.c_str());
-  pResponse->setResourceHandle(reinterpret_cast<void*>(targetId));
+  auto pResponse = std::make_shared<OC::OCResourceResponse>();
+  pResponse->setRequestHandle(pending.request);
+  pResponse->setResourceHandle(pending.resource);
 
   if (m_type == "retrieve") {
     // Send targetId representation
@@ -797,11 +1007,15 @@ OCStackResult IotivityRequestEvent::sendResponse() {
 
 OCStackResult IotivityRequestEvent::sendError() {
   OCStackResult result = OC_STACK_ERROR;
-  auto pResponse = std::make_shared<OC::OCResourceResponse>();
-  pResponse->setRequestHandle(reinterpret_cast<void*>(m_requestId));
+  IotivityServer::PendingRequest pending;
 
-  int targetId = atoi(m_target.c_str());
-  pResponse->setResourceHandle(reinterpret_cast<void*>(targetId));
+  if (!TakeRequest(m_device, m_requestId, pending)) {
+    return result;
+  }
+
+  auto pResponse = std::make_shared<OC::OCResourceResponse>();
+  pResponse->setRequestHandle(pending.request);
+  pResponse->setResourceHandle(pending.resource);
 
   // value.get("error").to_str()
   pResponse->setErrorCode(200);
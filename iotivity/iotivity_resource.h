@@ -30,16 +30,21 @@
 #ifndef IOTIVITY_IOTIVITY_RESOURCE_H_
 #define IOTIVITY_IOTIVITY_RESOURCE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
+#include "iotivity/iotivity_atom.h"
 #include "iotivity/iotivity_tools.h"
 #include "iotivity/iotivity_device.h"
+#include "iotivity/iotivity_writer.h"
 
 namespace common {
 class Instance;
 }
 
-// Map on JS OicResourceInit
+// Map on JS OicResourceInit, the resource types and interfaces shared by
+// many resources are interned
 class IotivityResourceInit {
  public:
   std::string m_url;
@@ -50,22 +55,26 @@ class IotivityResourceInit {
   bool m_observable;
   bool m_isSecure;
 
-  std::vector<std::string> m_resourceTypeNameArray;
-  std::string m_resourceTypeName;
-  std::vector<std::string> m_resourceInterfaceArray;
-  std::string m_resourceInterface;
+  std::vector<IotivityAtom> m_resourceTypeNameArray;
+  IotivityAtom m_resourceTypeName;
+  std::vector<IotivityAtom> m_resourceInterfaceArray;
+  IotivityAtom m_resourceInterface;
 
   uint8_t m_resourceProperty;
 
   OCRepresentation m_resourceRep;
 
  public:
-  explicit IotivityResourceInit(const picojson::value& value);
+  // |properties| were pre-parsed from the message, taken when not NULL
+  explicit IotivityResourceInit(const picojson::value& value,
+                                OCRepresentation* properties = NULL);
   IotivityResourceInit();
   ~IotivityResourceInit();
 
-  void deserialize(const picojson::value& value);
+  void deserialize(const picojson::value& value,
+                   OCRepresentation* properties = NULL);
   void serialize(picojson::object& object);
+  void serialize(IotivityMessageWriter& writer);
 };
 
 // Map on JS OicResource
@@ -76,6 +85,8 @@ class IotivityResourceServer {
   OCResourceHandle m_resourceHandle;
   ObservationIds m_interestedObservers;
   std::string m_idfull;
+  // Sync queries read the representation from the messaging thread
+  std::mutex m_lock;
 
  public:
   IotivityResourceServer(IotivityDevice* device,
@@ -85,26 +96,47 @@ class IotivityResourceServer {
   OCEntityHandlerResult entityHandlerCallback(
       std::shared_ptr<OCResourceRequest> request);
   OCStackResult registerResource();
+  OCStackResult unregisterResource();
 
-  int getResourceHandleToInt();
+  OCResourceHandle getResourceHandle();
   std::string getResourceId();
+  void setResourceId(const std::string& id);
   OCRepresentation getRepresentation();
-  ObservationIds& getObserversList();
+  ObservationIds getObserversList();
+  size_t getObserverCount();
   void serialize(picojson::object& object);
 };
 
-// Map on JS OicResource
-class IotivityResourceClient {
+// Shared by the server registry and the handlers using a resource, so an
+// unregister does not free it under them
+typedef std::shared_ptr<IotivityResourceServer> IotivityResourceServerPtr;
+
+// Map on JS OicResource. Always owned by a shared_ptr: stack callbacks of
+// running requests and observations hold a reference of their own.
+class IotivityResourceClient
+  : public std::enable_shared_from_this<IotivityResourceClient> {
  private:
   IotivityDevice* m_device;
 
   shared_ptr<OCResource> m_ocResourcePtr;
   IotivityResourceInit* m_oicResourceInit;
 
-  int m_id;
   std::string m_idfull;
   std::string m_sid;
   std::string m_host;
+  // Sync queries read the representation from the messaging thread
+  std::mutex m_lock;
+  // Last encodings of the whole resource object, empty once it changed
+  std::string m_jsonObject;
+  std::string m_cborObject;
+  // Requests waiting for their callback, and a running observation; both
+  // keep the resource from being evicted
+  std::atomic<int> m_inFlight;
+  std::atomic<bool> m_observing;
+
+  void setRepresentation(const OCRepresentation& rep);
+  // m_lock held
+  void serializeLocked(IotivityMessageWriter& writer);
 
  public:
   explicit IotivityResourceClient(IotivityDevice* device);
@@ -112,9 +144,17 @@ class IotivityResourceClient {
 
   const std::shared_ptr<OCResource> getSharedPtr();
   void setSharedPtr(std::shared_ptr<OCResource> sharePtr);
-  int getResourceHandleToInt();
   std::string getResourceId();
-  void serialize(picojson::object& object);
+  std::string getDeviceId();
+  void setDeviceId(const std::string& deviceId);
+  std::string getHost();
+  std::vector<IotivityAtom> getResourceTypes();
+  std::vector<IotivityAtom> getInterfaces();
+  bool getRepresentation(OCRepresentation& rep);
+  bool isEvictable();
+  size_t getMemoryUsage();
+  void serialize(IotivityMessageWriter& writer);
+  void serializeObject(IotivityMessageWriter& writer);
 
   void onPut(const HeaderOptions& headerOptions, const OCRepresentation& rep,
              const int eCode, double asyncCallId);
@@ -147,7 +187,8 @@ class IotivityRequestEvent {
   IotivityDevice* m_device;
 
   std::string m_type;
-  int m_requestId;
+  // Handle of the pending request in the server, see IotivityServer
+  uint64_t m_requestId;
   std::string m_source;
   std::string m_target;
 
@@ -164,8 +205,9 @@ class IotivityRequestEvent {
   ~IotivityRequestEvent();
 
   void deserialize(std::shared_ptr<OCResourceRequest> request);
-  void deserialize(const picojson::value& value);
-  void serialize(picojson::object& object);
+  void deserialize(const picojson::value& value,
+                   OCRepresentation* properties = NULL);
+  void serialize(IotivityMessageWriter& writer);
 
   OCStackResult sendResponse();
   OCStackResult sendError();
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_resource_index.h"
+
+#include <algorithm>
+#include <iterator>
+#include "iotivity/iotivity_resource.h"
+
+IotivityResourceIndex::IotivityResourceIndex(size_t budget)
+  : m_bytes(0), m_budget(budget), m_evictions(0), m_evictedBytes(0) {
+}
+
+namespace {
+
+// Index key of a filter value, atoms are looked up without interning
+bool FindKey(const std::string& value, std::string& key) {
+  key = value;
+  return true;
+}
+
+bool FindKey(const std::string& value, IotivityAtom& key) {
+  return IotivityAtom::find(value, key);
+}
+
+}  // namespace
+
+template <typename Index>
+void IotivityResourceIndex::link(Index& index,
+                                 const typename Index::key_type& key,
+                                 const std::string& id) {
+  if (!key.empty()) {
+    index[key].insert(id);
+  }
+}
+
+template <typename Index>
+void IotivityResourceIndex::unlink(Index& index,
+                                   const typename Index::key_type& key,
+                                   const std::string& id) {
+  auto it = index.find(key);
+
+  if (it == index.end()) {
+    return;
+  }
+
+  it->second.erase(id);
+  if (it->second.empty()) {
+    index.erase(it);
+  }
+}
+
+template <typename Index>
+void IotivityResourceIndex::collect(const Index& index,
+                                    const std::vector<std::string>& keys,
+                                    std::set<std::string>& ids) {
+  for (auto const &value : keys) {
+    typename Index::key_type key;
+    if (!FindKey(value, key)) {
+      continue;
+    }
+
+    auto it = index.find(key);
+    if (it != index.end()) {
+      ids.insert(it->second.begin(), it->second.end());
+    }
+  }
+}
+
+// Intersects matches with the resources of any of keys, false once
+// nothing matches anymore
+template <typename Index>
+bool IotivityResourceIndex::narrow(const Index& index,
+                                   const std::vector<std::string>& keys,
+                                   std::set<std::string>& matches,
+                                   bool& filtered) {
+  if (keys.empty()) {
+    return true;
+  }
+
+  std::set<std::string> found;
+  collect(index, keys, found);
+
+  if (!filtered) {
+    matches.swap(found);
+    filtered = true;
+  } else {
+    std::set<std::string> both;
+    std::set_intersection(matches.begin(), matches.end(), found.begin(),
+                          found.end(), std::inserter(both, both.end()));
+    matches.swap(both);
+  }
+
+  return !matches.empty();
+}
+
+void IotivityResourceIndex::unlinkEntry(const std::string& id,
+                                        const Entry& entry) {
+  unlink(m_byDevice, entry.deviceId, id);
+  unlink(m_byHost, entry.host, id);
+
+  for (auto const &type : entry.types) {
+    unlink(m_byType, type, id);
+  }
+
+  for (auto const &resourceInterface : entry.interfaces) {
+    unlink(m_byInterface, resourceInterface, id);
+  }
+}
+
+IotivityResourceClientPtr IotivityResourceIndex::insert(
+  const IotivityResourceClientPtr& resource) {
+  std::string id = resource->getResourceId();
+  auto it = m_entries.find(id);
+
+  if (it != m_entries.end()) {
+    touch(id);
+    return it->second.resource;
+  }
+
+  Entry entry;
+  entry.resource = resource;
+  entry.deviceId = resource->getDeviceId();
+  entry.host = resource->getHost();
+  entry.types = resource->getResourceTypes();
+  entry.interfaces = resource->getInterfaces();
+
+  link(m_byDevice, entry.deviceId, id);
+  link(m_byHost, entry.host, id);
+
+  for (auto const &type : entry.types) {
+    link(m_byType, type, id);
+  }
+
+  for (auto const &resourceInterface : entry.interfaces) {
+    link(m_byInterface, resourceInterface, id);
+  }
+
+  m_lru.push_front(id);
+  entry.lru = m_lru.begin();
+  entry.bytes = resource->getMemoryUsage();
+  m_bytes += entry.bytes;
+
+  m_entries[id] = entry;
+  return resource;
+}
+
+IotivityResourceClientPtr IotivityResourceIndex::remove(
+  const std::string& id) {
+  auto it = m_entries.find(id);
+
+  if (it == m_entries.end()) {
+    return IotivityResourceClientPtr();
+  }
+
+  IotivityResourceClientPtr resource = it->second.resource;
+  unlinkEntry(id, it->second);
+  m_lru.erase(it->second.lru);
+  m_bytes -= it->second.bytes;
+  m_entries.erase(it);
+  return resource;
+}
+
+IotivityResourceClientPtr IotivityResourceIndex::find(
+  const std::string& id) const {
+  auto it = m_entries.find(id);
+  return it == m_entries.end() ? IotivityResourceClientPtr() :
+         it->second.resource;
+}
+
+void IotivityResourceIndex::touch(const std::string& id) {
+  auto it = m_entries.find(id);
+
+  if (it == m_entries.end()) {
+    return;
+  }
+
+  Entry& entry = it->second;
+  m_lru.splice(m_lru.begin(), m_lru, entry.lru);
+  m_bytes -= entry.bytes;
+  entry.bytes = entry.resource->getMemoryUsage();
+  m_bytes += entry.bytes;
+}
+
+bool IotivityResourceIndex::overBudget() const {
+  return m_budget != 0 && m_bytes > m_budget;
+}
+
+void IotivityResourceIndex::evict(
+  const std::function<bool(const IotivityResourceClientPtr&)>& evictable,
+  std::vector<IotivityResourceClientPtr>& evicted) {
+  auto it = m_lru.end();
+
+  while (overBudget() && it != m_lru.begin()) {
+    --it;
+    Entry& entry = m_entries.find(*it)->second;
+
+    if (!evictable(entry.resource)) {
+      continue;
+    }
+
+    // Other list positions stay valid across the removal
+    std::string id = *it++;
+    m_evictions++;
+    m_evictedBytes += entry.bytes;
+    evicted.push_back(remove(id));
+  }
+}
+
+void IotivityResourceIndex::query(const Query& query,
+                                  std::vector<std::string>& ids) const {
+  std::set<std::string> matches;
+  bool filtered = false;
+
+  // Stops at the first option nothing matches
+  narrow(m_byDevice, query.deviceIds, matches, filtered) &&
+    narrow(m_byHost, query.hosts, matches, filtered) &&
+    narrow(m_byType, query.resourceTypes, matches, filtered) &&
+    narrow(m_byInterface, query.interfaces, matches, filtered);
+
+  if (!filtered) {
+    for (auto const &entry : m_entries) {
+      matches.insert(entry.first);
+    }
+  }
+
+  ids.assign(matches.begin(), matches.end());
+}
+
+void IotivityResourceIndex::resources(
+  std::vector<IotivityResourceClientPtr>& resources) const {
+  resources.reserve(resources.size() + m_entries.size());
+
+  for (auto const &entry : m_entries) {
+    resources.push_back(entry.second.resource);
+  }
+}
+
+size_t IotivityResourceIndex::size() const { return m_entries.size(); }
+
+void IotivityResourceIndex::clear() {
+  m_entries.clear();
+  m_lru.clear();
+  m_bytes = 0;
+  m_byDevice.clear();
+  m_byHost.clear();
+  m_byType.clear();
+  m_byInterface.clear();
+}
+
+void IotivityResourceIndex::getStats(picojson::object& object) const {
+  object["resources"] = picojson::value(static_cast<double>(m_entries.size()));
+  object["bytes"] = picojson::value(static_cast<double>(m_bytes));
+  object["budget"] = picojson::value(static_cast<double>(m_budget));
+  object["evictions"] = picojson::value(static_cast<double>(m_evictions));
+  object["evictedBytes"] =
+    picojson::value(static_cast<double>(m_evictedBytes));
+}
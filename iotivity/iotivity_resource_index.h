@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_RESOURCE_INDEX_H_
+#define IOTIVITY_IOTIVITY_RESOURCE_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common/picojson.h"
+#include "iotivity/iotivity_atom.h"
+
+class IotivityResourceClient;
+typedef std::shared_ptr<IotivityResourceClient> IotivityResourceClientPtr;
+
+// Discovered resources by resource id, with hash indexes on their device
+// id, host, resource types and interfaces kept in step on every insert
+// and remove. Types and interfaces are keyed by atom, values never interned
+// match nothing.
+//
+// Resources are also kept in least recently used order with an estimate of
+// their footprint, so the oldest can be evicted once a memory budget is
+// exceeded. A budget of 0 never evicts.
+//
+// The index shares the ownership of its resources with discoveries and
+// running requests. It does not lock, the client holds its resource lock
+// around every call.
+class IotivityResourceIndex {
+ public:
+  // A resource matches with any of the values of each non empty list and
+  // must match every non empty list
+  struct Query {
+    std::vector<std::string> deviceIds;
+    std::vector<std::string> hosts;
+    std::vector<std::string> resourceTypes;
+    std::vector<std::string> interfaces;
+  };
+
+ private:
+  // The keys a resource was indexed under, its own may change later
+  struct Entry {
+    IotivityResourceClientPtr resource;
+    std::string deviceId;
+    std::string host;
+    std::vector<IotivityAtom> types;
+    std::vector<IotivityAtom> interfaces;
+    std::list<std::string>::iterator lru;
+    size_t bytes;
+  };
+
+  typedef std::unordered_map<std::string, std::set<std::string>> KeyIndex;
+  typedef std::unordered_map<IotivityAtom, std::set<std::string>> AtomIndex;
+
+  std::unordered_map<std::string, Entry> m_entries;
+  KeyIndex m_byDevice;
+  KeyIndex m_byHost;
+  AtomIndex m_byType;
+  AtomIndex m_byInterface;
+
+  // Most recently used first
+  std::list<std::string> m_lru;
+  size_t m_bytes;
+  size_t m_budget;
+  uint64_t m_evictions;
+  uint64_t m_evictedBytes;
+
+  template <typename Index>
+  static void link(Index& index, const typename Index::key_type& key,
+                   const std::string& id);
+  template <typename Index>
+  static void unlink(Index& index, const typename Index::key_type& key,
+                     const std::string& id);
+  template <typename Index>
+  static void collect(const Index& index,
+                      const std::vector<std::string>& keys,
+                      std::set<std::string>& ids);
+  template <typename Index>
+  static bool narrow(const Index& index, const std::vector<std::string>& keys,
+                     std::set<std::string>& matches, bool& filtered);
+  void unlinkEntry(const std::string& id, const Entry& entry);
+
+ public:
+  explicit IotivityResourceIndex(size_t budget);
+
+  // Indexes a new resource and returns it. A resource already indexed
+  // under the same id is kept and returned instead, pages and observations
+  // keep using the same object.
+  IotivityResourceClientPtr insert(const IotivityResourceClientPtr& resource)
+    __attribute__((warn_unused_result));
+  IotivityResourceClientPtr remove(const std::string& id);
+  IotivityResourceClientPtr find(const std::string& id) const;
+  // Marks the resource used and accounts its current footprint
+  void touch(const std::string& id);
+  bool overBudget() const;
+  // Removes least recently used resources accepted by |evictable| until
+  // the index fits its budget again
+  void evict(
+    const std::function<bool(const IotivityResourceClientPtr&)>& evictable,
+    std::vector<IotivityResourceClientPtr>& evicted);
+  // Matching resource ids in ascending order
+  void query(const Query& query, std::vector<std::string>& ids) const;
+  void resources(std::vector<IotivityResourceClientPtr>& resources) const;
+  size_t size() const;
+  void clear();
+  void getStats(picojson::object& object) const;
+};
+
+#endif  // IOTIVITY_IOTIVITY_RESOURCE_INDEX_H_
@@ -28,60 +28,130 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <string>
-#include <map>
 #include "iotivity/iotivity_server.h"
 #include "iotivity/iotivity_device.h"
 #include "iotivity/iotivity_resource.h"
 
+// Unanswered requests older than this are dropped once the map is large,
+// the stack has given up on them long before
+static const size_t kMaxPendingRequests = 4096;
+static const int64_t kPendingRequestTtlMs = 60000;
+
 IotivityServer::IotivityServer(IotivityDevice* device) : m_device(device) {}
 
 IotivityServer::~IotivityServer() {}
 
-IotivityResourceServer* IotivityServer::getResourceById(std::string id) {
-  if (m_resourcemap.size()) {
-    std::map<std::string, IotivityResourceServer*>::const_iterator it;
-    if ((it = m_resourcemap.find(id)) != m_resourcemap.end())
-      return (*it).second;
+void IotivityServer::registerHandlers(IotivityDispatcher* dispatcher,
+                                      IotivityDevice* device) {
+  typedef void (IotivityServer::*ServerHandler)(const picojson::value&);
+  static const struct {
+    uint32_t id;
+    ServerHandler handler;
+  } kHandlers[] = {
+    {CommandHash("unregisterResource"),
+      &IotivityServer::handleUnregisterResource},
+    {CommandHash("enablePresence"), &IotivityServer::handleEnablePresence},
+    {CommandHash("disablePresence"), &IotivityServer::handleDisablePresence},
+    {CommandHash("notify"), &IotivityServer::handleNotify},
+  };
+
+  for (auto const& entry : kHandlers) {
+    ServerHandler handler = entry.handler;
+    dispatcher->registerHandler(entry.id,
+      [device, handler](const picojson::value& value) {
+        IotivityServer* server = device->getServer();
+        if (server == NULL) {
+          device->postError("server role not configured",
+                            GetAsyncCallId(value));
+          return;
+        }
+        (server->*handler)(value);
+      });
+  }
+
+  dispatcher->registerPropertiesHandler(CommandHash("registerResource"),
+    "OicResourceInit",
+    [device](const picojson::value& value, OCRepresentation* properties) {
+      IotivityServer* server = device->getServer();
+      if (server == NULL) {
+        device->postError("server role not configured", GetAsyncCallId(value));
+        return;
+      }
+      server->handleRegisterResource(value, properties);
+    });
+}
+
+IotivityResourceServerPtr IotivityServer::getResourceById(
+  const std::string& id) {
+  uint64_t handle;
+  IotivityResourceServerPtr resServer;
+
+  if (IotivitySlotMap<IotivityResourceServerPtr>::parse(id, handle)) {
+    m_resources.get(handle, resServer);
   }
 
-  return NULL;
+  return resServer;
 }
 
-void IotivityServer::handleRegisterResource(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleRegisterResource: v=%s\n",
-    value.serialize().c_str());
+uint64_t IotivityServer::addRequest(OCRequestHandle request,
+                                    OCResourceHandle resource) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  if (m_requests.size() >= kMaxPendingRequests) {
+    size_t dropped = m_requests.eraseIf([now](const PendingRequest& pending) {
+      return now - pending.created >=
+             std::chrono::milliseconds(kPendingRequestTtlMs);
+    });
+    OIC_LOG_V(DEBUG, TAG, "addRequest: dropped %d unanswered requests\n",
+              static_cast<int>(dropped));
+  }
 
+  PendingRequest pending;
+  pending.request = request;
+  pending.resource = resource;
+  pending.created = now;
+  return m_requests.insert(pending);
+}
+
+// A request is answered once, later answers find nothing
+bool IotivityServer::takeRequest(uint64_t requestId,
+                                 PendingRequest& pending) {
+  return m_requests.erase(requestId, &pending);
+}
+
+void IotivityServer::handleRegisterResource(const picojson::value& value,
+                                            OCRepresentation* properties) {
   double async_call_id = value.get("asyncCallId").get<double>();
   IotivityResourceInit* resInit =
-      new IotivityResourceInit(value.get("OicResourceInit"));
-  IotivityResourceServer* resServer =
-      new IotivityResourceServer(m_device, resInit);
+      new IotivityResourceInit(value.get("OicResourceInit"), properties);
+  IotivityResourceServerPtr resServer =
+      std::make_shared<IotivityResourceServer>(m_device, resInit);
+  // The id is known before the first request can reach the entity handler
+  uint64_t handle = m_resources.insert(resServer);
+  resServer->setResourceId(
+      IotivitySlotMap<IotivityResourceServerPtr>::toString(handle));
   OCStackResult result = resServer->registerResource();
 
   if (OC_STACK_OK != result) {
+    m_resources.erase(handle);
     m_device->postError("registerResource failed", async_call_id);
     return;
   }
 
-  std::string resourceId = resServer->getResourceId();
-  m_resourcemap[resourceId] = resServer;
   picojson::value::object object;
   object["cmd"] = picojson::value("registerResourceCompleted");
   object["asyncCallId"] = picojson::value(async_call_id);
   resServer->serialize(object);
   picojson::value postvalue(object);
-  m_device->PostMessage(postvalue.serialize().c_str());
+  m_device->PostMessage(postvalue);
 }
 
 void IotivityServer::handleUnregisterResource(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleUnregisterResource: v=%s\n",
-    value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   std::string resId = value.get("resourceId").to_str();
 
-  // Find and delete IotivityResourceServer *oicResourceServer
-  IotivityResourceServer* resServer = getResourceById(resId);
+  // Freed once the handlers still using it are done
+  IotivityResourceServerPtr resServer = getResourceById(resId);
 
   if (resServer == NULL) {
     m_device->postError("handleUnregisterResource, resource not found",
@@ -89,25 +159,21 @@ void IotivityServer::handleUnregisterResource(const picojson::value& value) {
     return;
   }
 
-  OCResourceHandle resHandle =
-      reinterpret_cast<OCResourceHandle>(resServer->getResourceHandleToInt());
-  OCStackResult result = OCPlatform::unregisterResource(resHandle);
+  OCStackResult result = resServer->unregisterResource();
 
   if (OC_STACK_OK != result) {
     m_device->postError("unregisterResource failed", async_call_id);
     return;
   }
 
-  m_resourcemap.erase(resId);
-  delete resServer;
+  uint64_t handle;
+  IotivitySlotMap<IotivityResourceServerPtr>::parse(resId, handle);
+  m_resources.erase(handle);
 
   m_device->postResult("unregisterResourceCompleted", async_call_id);
 }
 
 void IotivityServer::handleEnablePresence(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleEnablePresence: v=%s\n",
-    value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   unsigned int ttl = 0;  // default
   OCStackResult result = OCPlatform::startPresence(ttl);
@@ -121,9 +187,6 @@ void IotivityServer::handleEnablePresence(const picojson::value& value) {
 }
 
 void IotivityServer::handleDisablePresence(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleDisablePresence: v=%s\n",
-    value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   OCStackResult result = OCPlatform::stopPresence();
 
@@ -136,14 +199,12 @@ void IotivityServer::handleDisablePresence(const picojson::value& value) {
 }
 
 void IotivityServer::handleNotify(const picojson::value& value) {
-  OIC_LOG_V(DEBUG, TAG, "handleNotify: v=%s\n", value.serialize().c_str());
-
   double async_call_id = value.get("asyncCallId").get<double>();
   std::string resId = value.get("resourceId").to_str();
   std::string method = value.get("method").to_str();
   picojson::value updatedPropertyNames = value.get("updatedPropertyNames");
 
-  IotivityResourceServer* resServer = getResourceById(resId);
+  IotivityResourceServerPtr resServer = getResourceById(resId);
 
   if (resServer == NULL) {
     m_device->postError("handleNotify, resource not found",
@@ -157,10 +218,9 @@ void IotivityServer::handleNotify(const picojson::value& value) {
     pResponse->setResourceRepresentation(resServer->getRepresentation(),
                                          DEFAULT_INTERFACE);
 
-    OCResourceHandle resHandle =
-        reinterpret_cast<OCResourceHandle>(resServer->getResourceHandleToInt());
+    OCResourceHandle resHandle = resServer->getResourceHandle();
 
-    ObservationIds& observationIds = resServer->getObserversList();
+    ObservationIds observationIds = resServer->getObserversList();
     OCStackResult result =
         OCPlatform::notifyListOfObservers(resHandle, observationIds, pResponse);
     if (OC_STACK_OK != result) {
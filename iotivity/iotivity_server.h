@@ -30,24 +30,43 @@
 #ifndef IOTIVITY_IOTIVITY_SERVER_H_
 #define IOTIVITY_IOTIVITY_SERVER_H_
 
-#include <map>
+#include <chrono>
 #include <string>
 #include "iotivity/iotivity_tools.h"
+#include "iotivity/iotivity_handles.h"
 #include "iotivity/iotivity_resource.h"
+#include "iotivity/iotivity_dispatcher.h"
 
 class IotivityDevice;
 
 class IotivityServer {
+ public:
+  // A request passed to JS by the entity handler, until JS answers it
+  struct PendingRequest {
+    OCRequestHandle request;
+    OCResourceHandle resource;
+    std::chrono::steady_clock::time_point created;
+  };
+
  private:
   IotivityDevice* m_device;
-  std::map<std::string, IotivityResourceServer*> m_resourcemap;
+  // Handlers for different resources run on different workers, both maps
+  // lock internally
+  IotivitySlotMap<IotivityResourceServerPtr> m_resources;
+  IotivitySlotMap<PendingRequest> m_requests;
 
  public:
   explicit IotivityServer(IotivityDevice* device);
   ~IotivityServer();
 
-  IotivityResourceServer* getResourceById(std::string id);
-  void handleRegisterResource(const picojson::value& value);
+  static void registerHandlers(IotivityDispatcher* dispatcher,
+                               IotivityDevice* device);
+
+  IotivityResourceServerPtr getResourceById(const std::string& id);
+  uint64_t addRequest(OCRequestHandle request, OCResourceHandle resource);
+  bool takeRequest(uint64_t requestId, PendingRequest& pending);
+  void handleRegisterResource(const picojson::value& value,
+                              OCRepresentation* properties);
   void handleUnregisterResource(const picojson::value& value);
   void handleEnablePresence(const picojson::value& value);
   void handleDisablePresence(const picojson::value& value);
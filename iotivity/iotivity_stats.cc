@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_stats.h"
+
+#include <stdio.h>
+#include <chrono>
+
+#include "iotivity/iotivity_tools.h"
+
+// Commands whose completion never comes (observations dropped by the
+// remote, discovery without results) are forgotten once this many wait:
+// those older than kPendingTtlUs go first, or else the oldest one
+static const size_t kMaxPending = 4096;
+static const uint64_t kPendingTtlUs = 60000000;
+
+// Makes room in a full pending map, returns how many entries were dropped
+template <typename Map, typename ReceivedUs>
+static uint64_t ExpirePending(Map& map, uint64_t nowUs,
+                              ReceivedUs receivedUs) {
+  uint64_t expired = 0;
+  typename Map::iterator oldest = map.end();
+
+  for (typename Map::iterator it = map.begin(); it != map.end();) {
+    uint64_t us = receivedUs(it->second);
+
+    if (us < nowUs && nowUs - us > kPendingTtlUs) {
+      it = map.erase(it);
+      expired++;
+      continue;
+    }
+
+    if (oldest == map.end() || us < receivedUs(oldest->second)) {
+      oldest = it;
+    }
+    ++it;
+  }
+
+  if (expired == 0 && oldest != map.end()) {
+    map.erase(oldest);
+    expired++;
+  }
+
+  return expired;
+}
+
+static void UpdateMax(std::atomic<uint64_t>& max, uint64_t value) {
+  uint64_t current = max.load();
+
+  while (value > current && !max.compare_exchange_weak(current, value)) {
+  }
+}
+
+static double ToDouble(const std::atomic<uint64_t>& counter) {
+  return static_cast<double>(counter.load());
+}
+
+LatencyHistogram::LatencyHistogram()
+  : m_count(0), m_errors(0), m_totalUs(0), m_maxUs(0) {
+  for (int i = 0; i < kBuckets; i++) {
+    m_buckets[i] = 0;
+  }
+}
+
+int LatencyHistogram::bucketOf(uint64_t us) {
+  if (us < 2 * kSubBuckets) {
+    return static_cast<int>(us);
+  }
+
+  int msb = 63 - __builtin_clzll(us);
+  int shift = msb - 3;
+  int bucket = 2 * kSubBuckets + (shift - 1) * kSubBuckets +
+               static_cast<int>((us >> shift) - kSubBuckets);
+
+  return bucket < kBuckets ? bucket : kBuckets - 1;
+}
+
+uint64_t LatencyHistogram::bucketValue(int bucket) {
+  if (bucket < 2 * kSubBuckets) {
+    return bucket;
+  }
+
+  int shift = (bucket - 2 * kSubBuckets) / kSubBuckets + 1;
+  uint64_t mantissa = (bucket - 2 * kSubBuckets) % kSubBuckets + kSubBuckets;
+
+  // Highest value of the bucket
+  return ((mantissa + 1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(uint64_t count, double fraction) {
+  uint64_t rank = static_cast<uint64_t>(count * fraction);
+  uint64_t seen = 0;
+
+  if (rank >= count) rank = count - 1;
+
+  for (int i = 0; i < kBuckets; i++) {
+    seen += m_buckets[i].load(std::memory_order_relaxed);
+
+    if (seen > rank) {
+      uint64_t value = bucketValue(i);
+      uint64_t max = m_maxUs.load();
+      return value < max ? value : max;
+    }
+  }
+
+  return m_maxUs.load();
+}
+
+void LatencyHistogram::record(uint64_t us, bool error) {
+  m_buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+  m_totalUs.fetch_add(us, std::memory_order_relaxed);
+  UpdateMax(m_maxUs, us);
+
+  if (error) m_errors.fetch_add(1, std::memory_order_relaxed);
+
+  m_count.fetch_add(1, std::memory_order_release);
+}
+
+void LatencyHistogram::serialize(picojson::object& object) {
+  uint64_t count = m_count.load(std::memory_order_acquire);
+
+  object["count"] = picojson::value(static_cast<double>(count));
+  object["errors"] = picojson::value(ToDouble(m_errors));
+  object["maxUs"] = picojson::value(ToDouble(m_maxUs));
+
+  if (count == 0) return;
+
+  object["meanUs"] = picojson::value(ToDouble(m_totalUs) / count);
+  object["p50Us"] =
+    picojson::value(static_cast<double>(percentile(count, 0.5)));
+  object["p90Us"] =
+    picojson::value(static_cast<double>(percentile(count, 0.9)));
+  object["p99Us"] =
+    picojson::value(static_cast<double>(percentile(count, 0.99)));
+  object["p999Us"] =
+    picojson::value(static_cast<double>(percentile(count, 0.999)));
+}
+
+IotivityStats::IotivityStats()
+  : m_messagesIn(0), m_bytesIn(0), m_messagesOut(0), m_bytesOut(0),
+    m_errors(0), m_untracked(0) {
+}
+
+uint64_t IotivityStats::now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyHistogram* IotivityStats::histogram(HistogramMap& map,
+                                           const std::string& name) {
+  std::unique_ptr<LatencyHistogram>& histogram = map[name];
+
+  if (!histogram) {
+    histogram.reset(new LatencyHistogram());
+  }
+
+  return histogram.get();
+}
+
+void IotivityStats::serialize(HistogramMap& map, picojson::object& object) {
+  for (auto& entry : map) {
+    picojson::object histogram;
+    entry.second->serialize(histogram);
+    object[entry.first] = picojson::value(histogram);
+  }
+}
+
+void IotivityStats::messageIn(size_t bytes) {
+  m_messagesIn.fetch_add(1, std::memory_order_relaxed);
+  m_bytesIn.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void IotivityStats::messageOut(size_t bytes) {
+  m_messagesOut.fetch_add(1, std::memory_order_relaxed);
+  m_bytesOut.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void IotivityStats::commandReceived(const std::string& command,
+                                    double asyncCallId, uint64_t receivedUs) {
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  if (m_pendingCommands.size() >= kMaxPending) {
+    m_untracked += ExpirePending(m_pendingCommands, receivedUs,
+                                 [](const Pending& pending) {
+                                   return pending.receivedUs;
+                                 });
+  }
+
+  Pending& pending = m_pendingCommands[static_cast<int64_t>(asyncCallId)];
+  pending.command = command;
+  pending.receivedUs = receivedUs;
+}
+
+void IotivityStats::commandCompleted(const char* event, double asyncCallId,
+                                     bool error) {
+  uint64_t completedUs = now();
+
+  if (error) m_errors++;
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  auto it = m_pendingCommands.find(static_cast<int64_t>(asyncCallId));
+
+  if (it == m_pendingCommands.end()) {
+    return;
+  }
+
+  uint64_t latencyUs = completedUs - it->second.receivedUs;
+  histogram(m_commands, it->second.command)->record(latencyUs, error);
+  histogram(m_events, event)->record(latencyUs, error);
+  m_pendingCommands.erase(it);
+}
+
+void IotivityStats::messagePosted(const picojson::value& value) {
+  if (!value.is<picojson::object>()) {
+    return;
+  }
+
+  const picojson::object& object = value.get<picojson::object>();
+  picojson::object::const_iterator cmd = object.find("cmd");
+  picojson::object::const_iterator asyncCallId = object.find("asyncCallId");
+
+  if (cmd == object.end() || !cmd->second.is<std::string>() ||
+      asyncCallId == object.end() || !asyncCallId->second.is<double>()) {
+    return;
+  }
+
+  const std::string& event = cmd->second.get<std::string>();
+  commandCompleted(event.c_str(), asyncCallId->second.get<double>(),
+                   event == "asyncCallError");
+}
+
+void IotivityStats::entityHandled(uint64_t requestId, uint64_t startUs) {
+  uint64_t postedUs = now();
+  m_entityHandler.record(postedUs - startUs, false);
+
+  std::lock_guard<std::mutex> lock(m_lock);
+
+  if (m_pendingRequests.size() >= kMaxPending) {
+    m_untracked += ExpirePending(m_pendingRequests, postedUs,
+                                 [](uint64_t pendingUs) {
+                                   return pendingUs;
+                                 });
+  }
+
+  m_pendingRequests[requestId] = postedUs;
+}
+
+void IotivityStats::requestAnswered(uint64_t requestId, bool error) {
+  uint64_t answeredUs = now();
+
+  std::lock_guard<std::mutex> lock(m_lock);
+  auto it = m_pendingRequests.find(requestId);
+
+  if (it == m_pendingRequests.end()) {
+    return;
+  }
+
+  m_requestResponse.record(answeredUs - it->second, error);
+  m_pendingRequests.erase(it);
+}
+
+void IotivityStats::getStats(picojson::object& object) {
+  picojson::object messages;
+  messages["in"] = picojson::value(ToDouble(m_messagesIn));
+  messages["bytesIn"] = picojson::value(ToDouble(m_bytesIn));
+  messages["out"] = picojson::value(ToDouble(m_messagesOut));
+  messages["bytesOut"] = picojson::value(ToDouble(m_bytesOut));
+  messages["errors"] = picojson::value(ToDouble(m_errors));
+  messages["untracked"] = picojson::value(ToDouble(m_untracked));
+  object["messages"] = picojson::value(messages);
+
+  picojson::object server;
+  picojson::object entityHandler;
+  picojson::object requestResponse;
+  m_entityHandler.serialize(entityHandler);
+  m_requestResponse.serialize(requestResponse);
+  server["entityHandler"] = picojson::value(entityHandler);
+  server["sendResponse"] = picojson::value(requestResponse);
+  object["server"] = picojson::value(server);
+
+  picojson::object commands;
+  picojson::object events;
+  std::lock_guard<std::mutex> lock(m_lock);
+  serialize(m_commands, commands);
+  serialize(m_events, events);
+  object["commands"] = picojson::value(commands);
+  object["events"] = picojson::value(events);
+  object["pendingCommands"] =
+    picojson::value(static_cast<double>(m_pendingCommands.size()));
+}
+
+bool IotivityStats::dump(const std::string& path) {
+  picojson::object stats;
+  getStats(stats);
+
+  FILE* file = fopen(path.c_str(), "w");
+
+  if (file == NULL) {
+    OIC_LOG_V(ERROR, TAG, "IotivityStats::dump: cannot open %s\n",
+      path.c_str());
+    return false;
+  }
+
+  std::string json = picojson::value(stats).serialize();
+  bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+
+  return fclose(file) == 0 && written;
+}
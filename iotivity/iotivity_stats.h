@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_STATS_H_
+#define IOTIVITY_IOTIVITY_STATS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common/picojson.h"
+
+// Log-linear latency histogram in microseconds, HDR style: 8 sub-buckets
+// per power of two, so every bucket is within 12.5% of its values.
+class LatencyHistogram {
+ public:
+  static const int kSubBuckets = 8;
+  static const int kBuckets = 2 * kSubBuckets + 40 * kSubBuckets;
+
+ private:
+  std::atomic<uint64_t> m_buckets[kBuckets];
+  std::atomic<uint64_t> m_count;
+  std::atomic<uint64_t> m_errors;
+  std::atomic<uint64_t> m_totalUs;
+  std::atomic<uint64_t> m_maxUs;
+
+  static int bucketOf(uint64_t us);
+  static uint64_t bucketValue(int bucket);
+  uint64_t percentile(uint64_t count, double fraction);
+
+ public:
+  LatencyHistogram();
+
+  void record(uint64_t us, bool error);
+  void serialize(picojson::object& object);
+};
+
+// Latency and traffic counters of the extension.
+//
+// A command starts when HandleMessage receives it and completes with the
+// first message posted back under its asyncCallId. Latencies are kept per
+// command and per completion event. On the server side the entity handler
+// run time and the time JS takes to answer a request are measured too.
+class IotivityStats {
+ private:
+  struct Pending {
+    std::string command;
+    uint64_t receivedUs;
+  };
+
+  typedef std::map<std::string, std::unique_ptr<LatencyHistogram>>
+    HistogramMap;
+
+  std::mutex m_lock;
+  std::unordered_map<int64_t, Pending> m_pendingCommands;
+  std::unordered_map<uint64_t, uint64_t> m_pendingRequests;
+  HistogramMap m_commands;
+  HistogramMap m_events;
+  LatencyHistogram m_entityHandler;
+  LatencyHistogram m_requestResponse;
+
+  std::atomic<uint64_t> m_messagesIn;
+  std::atomic<uint64_t> m_bytesIn;
+  std::atomic<uint64_t> m_messagesOut;
+  std::atomic<uint64_t> m_bytesOut;
+  std::atomic<uint64_t> m_errors;
+  std::atomic<uint64_t> m_untracked;
+
+  static LatencyHistogram* histogram(HistogramMap& map,
+                                     const std::string& name);
+  static void serialize(HistogramMap& map, picojson::object& object);
+
+ public:
+  IotivityStats();
+
+  static uint64_t now();
+
+  void messageIn(size_t bytes);
+  void messageOut(size_t bytes);
+
+  void commandReceived(const std::string& command, double asyncCallId,
+                       uint64_t receivedUs);
+  // Only the first completion of an asyncCallId is measured
+  void commandCompleted(const char* event, double asyncCallId, bool error);
+  // Checks posted objects for a cmd and an asyncCallId
+  void messagePosted(const picojson::value& value);
+
+  void entityHandled(uint64_t requestId, uint64_t startUs);
+  void requestAnswered(uint64_t requestId, bool error);
+
+  void getStats(picojson::object& object);
+  bool dump(const std::string& path);
+};
+
+#endif  // IOTIVITY_IOTIVITY_STATS_H_
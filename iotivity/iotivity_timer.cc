@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_timer.h"
+
+#include <algorithm>
+
+IotivityTimerWheel::IotivityTimerWheel(unsigned tickMs)
+  : m_tick(tickMs ? tickMs : 1), m_start(std::chrono::steady_clock::now()),
+    m_now(0), m_nextId(0), m_running(0), m_stopping(false) {
+  m_thread = std::thread(&IotivityTimerWheel::run, this);
+}
+
+IotivityTimerWheel::~IotivityTimerWheel() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    m_cond.notify_one();
+  }
+
+  m_thread.join();
+}
+
+uint64_t IotivityTimerWheel::currentTick() {
+  return (std::chrono::steady_clock::now() - m_start) / m_tick;
+}
+
+// Puts a timer in the slot matching its distance to the current tick,
+// moving it out of 'from' when it is already on the wheel
+void IotivityTimerWheel::place(Timer& timer, Slot* from) {
+  uint64_t delta = timer.expiry - m_now;
+  int level = 0;
+
+  while (level < kLevels - 1 &&
+         delta >= (static_cast<uint64_t>(1) << (kLevelBits * (level + 1)))) {
+    level++;
+  }
+
+  Slot* slot =
+    &m_slots[level][(timer.expiry >> (kLevelBits * level)) & (kSlots - 1)];
+  Location& location = m_index[timer.id];
+
+  if (from == NULL) {
+    location.timer = slot->insert(slot->end(), timer);
+  } else {
+    slot->splice(slot->end(), *from, location.timer);
+  }
+
+  location.slot = slot;
+}
+
+void IotivityTimerWheel::cascade(int level) {
+  Slot& slot =
+    m_slots[level][(m_now >> (kLevelBits * level)) & (kSlots - 1)];
+
+  while (!slot.empty()) {
+    place(slot.front(), &slot);
+  }
+}
+
+void IotivityTimerWheel::advance(std::unique_lock<std::mutex>& lock) {
+  m_now++;
+
+  // Higher levels turn when every level below wrapped around
+  for (int level = 1; level < kLevels; level++) {
+    uint64_t mask = (static_cast<uint64_t>(1) << (kLevelBits * level)) - 1;
+
+    if (m_now & mask) break;
+
+    cascade(level);
+  }
+
+  Slot& due = m_slots[0][m_now & (kSlots - 1)];
+
+  while (!due.empty()) {
+    Timer timer = due.front();
+    due.pop_front();
+    m_index.erase(timer.id);
+    m_running = timer.id;
+
+    lock.unlock();
+    timer.callback();
+    lock.lock();
+
+    m_running = 0;
+    m_idle.notify_all();
+  }
+}
+
+void IotivityTimerWheel::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (!m_stopping) {
+    if (m_index.empty()) {
+      // Nothing to turn the wheel for, idle ticks are skipped
+      m_now = std::max(m_now, currentTick());
+      m_cond.wait(lock);
+      continue;
+    }
+
+    if (m_now < currentTick()) {
+      advance(lock);
+      continue;
+    }
+
+    m_cond.wait_until(lock, m_start + m_tick * (m_now + 1));
+  }
+}
+
+IotivityTimerWheel::TimerId IotivityTimerWheel::schedule(
+  unsigned delayMs, const Callback& callback) {
+  static const uint64_t kMaxTicks =
+    (static_cast<uint64_t>(1) << (kLevelBits * kLevels)) - 1;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  uint64_t deadlineMs = delayMs +
+    std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - m_start).count();
+  Timer timer;
+
+  // First tick at or after the deadline, never the one being processed
+  timer.id = ++m_nextId;
+  timer.expiry = std::max((deadlineMs + m_tick.count() - 1) / m_tick.count(),
+                          m_now + 1);
+  timer.expiry = std::min(timer.expiry, m_now + kMaxTicks);
+  timer.callback = callback;
+  place(timer, NULL);
+
+  m_cond.notify_one();
+  return timer.id;
+}
+
+bool IotivityTimerWheel::cancel(TimerId id) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  auto it = m_index.find(id);
+
+  if (it != m_index.end()) {
+    it->second.slot->erase(it->second.timer);
+    m_index.erase(it);
+    return true;
+  }
+
+  // A callback cancelling itself must not wait for itself
+  if (std::this_thread::get_id() != m_thread.get_id()) {
+    m_idle.wait(lock, [this, id]() { return m_running != id; });
+  }
+
+  return false;
+}
+
+size_t IotivityTimerWheel::pending() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_index.size();
+}
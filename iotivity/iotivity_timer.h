@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_TIMER_H_
+#define IOTIVITY_IOTIVITY_TIMER_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// Owns every deadline of the extension on a single scheduler thread.
+//
+// Timers live in a hierarchical wheel of kLevels levels with kSlots slots
+// each: level 0 holds what expires within kSlots ticks, every higher level
+// covers kSlots times the range of the one below and cascades its timers
+// down when the wheel turns. Scheduling and cancelling are O(1), callbacks
+// run on the scheduler thread in expiry order.
+class IotivityTimerWheel {
+ public:
+  typedef std::function<void()> Callback;
+  // 0 is never a valid id
+  typedef uint64_t TimerId;
+
+ private:
+  static const int kLevelBits = 6;
+  static const int kSlots = 1 << kLevelBits;
+  static const int kLevels = 4;
+
+  struct Timer {
+    TimerId id;
+    uint64_t expiry;
+    Callback callback;
+  };
+
+  typedef std::list<Timer> Slot;
+
+  struct Location {
+    Slot* slot;
+    Slot::iterator timer;
+  };
+
+  std::chrono::milliseconds m_tick;
+  std::chrono::steady_clock::time_point m_start;
+  // Last tick processed by the scheduler thread
+  uint64_t m_now;
+  TimerId m_nextId;
+  TimerId m_running;
+  bool m_stopping;
+
+  Slot m_slots[kLevels][kSlots];
+  std::unordered_map<TimerId, Location> m_index;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::condition_variable m_idle;
+  std::thread m_thread;
+
+  uint64_t currentTick();
+  void place(Timer& timer, Slot* from);
+  void cascade(int level);
+  void advance(std::unique_lock<std::mutex>& lock);
+  void run();
+
+ public:
+  explicit IotivityTimerWheel(unsigned tickMs);
+  // Pending timers are dropped without running
+  ~IotivityTimerWheel();
+
+  TimerId schedule(unsigned delayMs, const Callback& callback);
+  // true when the timer was removed before running. When its callback is
+  // running on the scheduler thread, waits until it has returned.
+  bool cancel(TimerId id);
+  size_t pending();
+};
+
+#endif  // IOTIVITY_IOTIVITY_TIMER_H_
@@ -30,84 +30,7 @@
 #include "iotivity/iotivity_tools.h"
 #include <sstream>
 
-char* pDebugEnv = NULL;
-
-void PrintfOcResource(const OCResource& oCResource) {
-  OIC_LOG_V(DEBUG, TAG, "PrintfOcResource\n");
-  OIC_LOG_V(DEBUG, TAG, "\tRes[sId] = %s\n", oCResource.sid().c_str());
-  OIC_LOG_V(DEBUG, TAG, "\tRes[Uri] = %s\n", oCResource.uri().c_str());
-  OIC_LOG_V(DEBUG, TAG, "\tRes[Host] = %s\n", oCResource.host().c_str());
-  OIC_LOG_V(DEBUG, TAG, "\tRes[Resource types]:\n");
-
-  for (const auto& resourceTypes : oCResource.getResourceTypes()) {
-    OIC_LOG_V(DEBUG, TAG, "\t\t%s\n", resourceTypes.c_str());
-  }
-
-  OIC_LOG_V(DEBUG, TAG, "Res[Resource interfaces] \n");
-
-  for (const auto& resourceInterfaces : oCResource.getResourceInterfaces()) {
-    OIC_LOG_V(DEBUG, TAG, "\t\t%s\n", resourceInterfaces.c_str());
-  }
-}
-
-void PrintfOcRepresentation(const OCRepresentation& oCRepr) {
-  OIC_LOG_V(DEBUG, TAG, ">>PrintfOcRepresentation:\n");
-
-  std::string uri = oCRepr.getUri();
-  OIC_LOG_V(DEBUG, TAG, "\turi=%s\n", uri.c_str());
-
-  // IOT-828
-  // OIC_LOG_V(DEBUG, TAG, "\thost=%s\n", oCRepr.getHost().c_str());
-
-  OIC_LOG_V(DEBUG, TAG, "\ttypes=%s\n", uri.c_str());
-  for (const auto& resourceTypes : oCRepr.getResourceTypes()) {
-    OIC_LOG_V(DEBUG, TAG, "\t\t%s\n", resourceTypes.c_str());
-  }
-
-  OIC_LOG_V(DEBUG, TAG, "\tinterfaces=%s\n", uri.c_str());
-  for (const auto& resourceInterfaces : oCRepr.getResourceInterfaces()) {
-    OIC_LOG_V(DEBUG, TAG, "\t\t%s\n", resourceInterfaces.c_str());
-  }
-
-  for (const auto& cur : oCRepr) {
-    std::string attrname = cur.attrname();
-    OIC_LOG_V(DEBUG, TAG, "\tattr  key=%s\n", attrname.c_str());
-
-    if (AttributeType::String == cur.type()) {
-      std::string curStr = cur.getValue<string>();
-      OIC_LOG_V(DEBUG, TAG, "\tRep[String]: key=%s, value=%s\n",
-        attrname.c_str(), curStr.c_str());
-    } else if (AttributeType::Integer == cur.type()) {
-      OIC_LOG_V(DEBUG, TAG, "\tRep[Integer]: key=%s, value=%d\n",
-        attrname.c_str(), cur.getValue<int>());
-    } else if (AttributeType::Double == cur.type()) {
-      OIC_LOG_V(DEBUG, TAG, "\tRep[Double]: key=%s, value=%f\n",
-        attrname.c_str(), cur.getValue<double>());
-    } else if (AttributeType::Boolean == cur.type()) {
-      OIC_LOG_V(DEBUG, TAG, "\tRep[Boolean]: key=%s, value=%d\n",
-        attrname.c_str(), cur.getValue<bool>());
-    } else if (AttributeType::OCRepresentation == cur.type()) {
-      OIC_LOG_V(DEBUG, TAG, "\tRep[OCRepresentation]: key=%s, value=%s\n",
-                attrname.c_str(), "OCRep");
-      PrintfOcRepresentation(cur.getValue<OCRepresentation>());
-    } else if (AttributeType::Vector == cur.type()) {
-      OIC_LOG_V(DEBUG, TAG, "\tRep[OCRepresentation]: key=%s, value=%s\n",
-                attrname.c_str(), "Vector");
-      if (cur.base_type() == AttributeType::OCRepresentation) {
-        OIC_LOG_V(DEBUG, TAG, "\tVector of OCRepresentation\n");
-
-        std::vector<OCRepresentation> v =
-          cur.getValue<std::vector<OCRepresentation>>();
-        for (const auto& curv : v) {
-          OIC_LOG_V(DEBUG, TAG, "\t>>Print sub OCRepresentation\n");
-          PrintfOcRepresentation(curv);
-          OIC_LOG_V(DEBUG, TAG, "\t<<Print sub OCRepresentation\n");
-        }
-      }
-    }
-  }
-  OIC_LOG_V(DEBUG, TAG, "<<PrintfOcRepresentation:\n");
-}
+#include "iotivity/iotivity_trace.h"
 
 static void UpdateDestOcRepresentationString(OCRepresentation& oCReprDest,
     std::string attributeName,
@@ -221,11 +144,9 @@ static void UpdateDestOcRepresentationOCRep(OCRepresentation& oCReprDest,
 void UpdateOcRepresentation(const OCRepresentation& oCReprSource,
                             OCRepresentation& oCReprDest,
                             std::vector<std::string>& updatedPropertyNames) {
-  OIC_LOG_V(DEBUG, TAG, "\n\nUpdateOcRepresentation: Source\n");
-  PrintfOcRepresentation(oCReprSource);
-
-  OIC_LOG_V(DEBUG, TAG, "UpdateOcRepresentation: Destination\n");
-  PrintfOcRepresentation(oCReprDest);
+  IOTIVITY_TRACE(IOTIVITY_TRACE_DEBUG, TRACE_REPRESENTATION_UPDATE,
+                 oCReprSource.numberOfAttributes(),
+                 updatedPropertyNames.size());
 
   std::vector<std::string> foundPropertyNames;
   for (auto& cur : oCReprSource) {
@@ -310,12 +231,12 @@ void UpdateOcRepresentation(const OCRepresentation& oCReprSource,
 
 void PicojsonPropsToOCRep(
     OCRepresentation &rep,
-    picojson::object &props) {
+    const picojson::object &props) {
   OIC_LOG_V(DEBUG, TAG, ">>PicojsonPropsToOCRep \n");
-  for (picojson::value::object::iterator piter = props.begin();
+  for (picojson::value::object::const_iterator piter = props.begin();
      piter != props.end(); ++piter) {
-    std::string key = piter->first;
-    picojson::value value = piter->second;
+    const std::string& key = piter->first;
+    const picojson::value& value = piter->second;
 
     OIC_LOG_V(DEBUG, TAG, "\t>>key = %s\n", key.c_str());
 
@@ -338,8 +259,12 @@ void PicojsonPropsToOCRep(
       rep[key] = value.get<string>();
     } else if (value.is<picojson::array>()) {
       OIC_LOG_V(DEBUG, TAG, "\tarray val\n");
-      picojson::array array = value.get<picojson::array>();
-      picojson::array::iterator iter = array.begin();
+      const picojson::array& array = value.get<picojson::array>();
+      picojson::array::const_iterator iter = array.begin();
+
+      if (iter == array.end()) {
+        continue;
+      }
 
       if ((*iter).is<bool>()) {
         OIC_LOG_V(DEBUG, TAG, "\t\tbool base_type\n");
@@ -355,7 +280,7 @@ void PicojsonPropsToOCRep(
         std::vector<int> v;
         for (; iter != array.end(); ++iter) {
           if ((*iter).is<int>()) {
-            v.push_back((*iter).get<int>());
+            v.push_back(static_cast<int>((*iter).get<double>()));
           }
         }
         rep[key] = v;
@@ -381,8 +306,11 @@ void PicojsonPropsToOCRep(
         OIC_LOG_V(DEBUG, TAG, "\t\tobject base_type\n");
         std::vector<OCRepresentation> v;
         for (; iter != array.end(); ++iter) {
+          if (!(*iter).is<picojson::object>()) {
+            continue;
+          }
           OCRepresentation repi;
-          picojson::object propi = (*iter).get<picojson::object>();
+          const picojson::object& propi = (*iter).get<picojson::object>();
           PicojsonPropsToOCRep(repi, propi);
           v.push_back(repi);
         }
@@ -391,8 +319,7 @@ void PicojsonPropsToOCRep(
     }
     OIC_LOG_V(DEBUG, TAG, "\t<<key = %s\n", key.c_str());
   }
-  OIC_LOG_V(DEBUG, TAG, "<<PicojsonPropsToOCReps after:\n");
-  PrintfOcRepresentation(rep);
+  OIC_LOG_V(DEBUG, TAG, "<<PicojsonPropsToOCReps\n");
 }
 
 // Translate OCRepresentation to picojson
@@ -488,6 +415,22 @@ std::string getUserHome() {
     return ret;
 }
 
+// Tuning knob from the environment, |defaultValue| when unset or invalid
+size_t GetEnvSize(const char *name, size_t defaultValue) {
+    const char *p = getenv(name);
+    char *end = NULL;
+
+    if (p == NULL || *p == '\0')
+        return defaultValue;
+
+    long value = strtol(p, &end, 10);
+
+    if (*end != '\0' || value < 0)
+        return defaultValue;
+
+    return static_cast<size_t>(value);
+}
+
 bool file_exist(const char *filename) {
     struct stat buffer;
     return (stat(filename, &buffer) == 0);
@@ -61,19 +61,16 @@ static const char TAG[] = "IoT-Ext-Xwalk";
 
 #define SUCCESS_RESPONSE 0
 
-extern char *pDebugEnv;
-
 std::string getUserHome();
+size_t GetEnvSize(const char *name, size_t defaultValue);
 bool file_exist(const char *filename);
-void PrintfOcResource(const OCResource &oCResource);
-void PrintfOcRepresentation(const OCRepresentation &oCRepresentation);
 void UpdateOcRepresentation(const OCRepresentation &oCReprSource,
                             OCRepresentation &oCReprDest,
                             std::vector<std::string> &updatedPropertyNames);
 void TranslateOCRepresentationToPicojson(
     const OCRepresentation &oCRepresentation, picojson::object &objectRes);
 void PicojsonPropsToOCRep(
-     OCRepresentation &oCRepresentation, picojson::object &objectRes);
+     OCRepresentation &oCRepresentation, const picojson::object &objectRes);
 void CopyInto(std::vector<std::string> &src, picojson::array &dest);
 int GetWait(picojson::value v);
 
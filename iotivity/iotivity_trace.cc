@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+#include "iotivity/iotivity_dispatcher.h"
+
+std::atomic<bool> g_traceEnabled(getenv("IOTIVITY_TRACE") != NULL);
+
+namespace {
+
+const size_t kRingSize = 1024;
+// Rings of exited threads kept for the next dump
+const size_t kMaxRetiredRings = 8;
+
+const char* const kLevelNames[] = { "", "E", "I", "D" };
+
+const struct {
+  TraceEvent event;
+  const char* format;
+} kEventFormats[] = {
+  { TRACE_MESSAGE_IN, "message in: size=%lld, cbor=%lld" },
+  { TRACE_MESSAGE_OUT, "message out: size=%lld, cbor=%lld" },
+  { TRACE_MESSAGE_INVALID, "message ignored: size=%lld" },
+  { TRACE_COMMAND_START, "command %s start: asyncCallId=%lld" },
+  { TRACE_COMMAND_END, "command %s end: asyncCallId=%lld" },
+  { TRACE_COMMAND_UNKNOWN, "command %s unknown: asyncCallId=%lld" },
+  { TRACE_COMMAND_REJECTED, "command %s rejected: asyncCallId=%lld" },
+  { TRACE_REPRESENTATION_IN, "representation in: attributes=%lld, "
+                             "eCode=%lld" },
+  { TRACE_REPRESENTATION_OUT, "representation out: attributes=%lld, "
+                              "asyncCallId=%lld" },
+  { TRACE_REPRESENTATION_UPDATE, "representation update: source=%lld, "
+                                 "updated=%lld" },
+  { TRACE_RESOURCE_FOUND, "resource found: types=%lld, interfaces=%lld" },
+  { TRACE_REQUEST, "entity request: flags=%lld, attributes=%lld" },
+};
+
+// Commands named in the dump, the records only hold their hash
+const char* const kCommandNames[] = {
+  "batch", "cancelObserving", "configure", "createResource",
+  "deleteResource", "disablePresence", "enablePresence", "factoryReset",
+  "findDevices", "findResources", "getExecutorStats", "notify", "reboot",
+  "registerResource", "retrieveResource", "sendError", "sendResponse",
+  "startObserving", "unregisterResource", "updateResource",
+};
+
+struct Record {
+  // timestamp, level << 16 | event, arg0, arg1; atomics so a dump can
+  // read while the owner thread writes
+  std::atomic<uint64_t> words[4];
+};
+
+struct Ring {
+  uint64_t thread;
+  std::atomic<uint64_t> head;
+  Record records[kRingSize];
+
+  explicit Ring(uint64_t id) : thread(id), head(0) {}
+};
+
+std::mutex g_ringsLock;
+std::vector<std::shared_ptr<Ring>> g_rings;
+std::vector<std::shared_ptr<Ring>> g_retiredRings;
+uint64_t g_nextThread = 0;
+
+// Registers the ring of the current thread, retires it on thread exit
+class RingHolder {
+ public:
+  std::shared_ptr<Ring> ring;
+
+  RingHolder() {
+    std::lock_guard<std::mutex> lock(g_ringsLock);
+    ring = std::make_shared<Ring>(g_nextThread++);
+    g_rings.push_back(ring);
+  }
+
+  ~RingHolder() {
+    std::lock_guard<std::mutex> lock(g_ringsLock);
+    g_rings.erase(std::remove(g_rings.begin(), g_rings.end(), ring),
+                  g_rings.end());
+    g_retiredRings.push_back(ring);
+
+    if (g_retiredRings.size() > kMaxRetiredRings) {
+      g_retiredRings.erase(g_retiredRings.begin());
+    }
+  }
+};
+
+thread_local RingHolder t_ring;
+
+uint64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* EventFormat(unsigned event) {
+  for (auto const& entry : kEventFormats) {
+    if (static_cast<unsigned>(entry.event) == event) return entry.format;
+  }
+  return "event %lld %lld";
+}
+
+bool IsCommandEvent(unsigned event) {
+  return event == TRACE_COMMAND_START || event == TRACE_COMMAND_END ||
+         event == TRACE_COMMAND_UNKNOWN || event == TRACE_COMMAND_REJECTED;
+}
+
+std::string CommandName(uint32_t commandId) {
+  for (auto const name : kCommandNames) {
+    if (CommandHash(name) == commandId) return name;
+  }
+
+  char hex[16];
+  snprintf(hex, sizeof(hex), "0x%08x", commandId);
+  return hex;
+}
+
+struct Snapshot {
+  uint64_t time;
+  uint64_t thread;
+  uint64_t tag;
+  int64_t arg0;
+  int64_t arg1;
+};
+
+}  // namespace
+
+void TraceRecord(int level, TraceEvent event, int64_t arg0, int64_t arg1) {
+  Ring& ring = *t_ring.ring;
+  uint64_t head = ring.head.load(std::memory_order_relaxed);
+  Record& record = ring.records[head % kRingSize];
+
+  record.words[0].store(Now(), std::memory_order_relaxed);
+  record.words[1].store((static_cast<uint64_t>(level) << 16) | event,
+                        std::memory_order_relaxed);
+  record.words[2].store(static_cast<uint64_t>(arg0),
+                        std::memory_order_relaxed);
+  record.words[3].store(static_cast<uint64_t>(arg1),
+                        std::memory_order_relaxed);
+  ring.head.store(head + 1, std::memory_order_release);
+}
+
+void TraceSetEnabled(bool enabled) {
+  g_traceEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void TraceDump(std::vector<std::string>& lines) {
+  std::vector<std::shared_ptr<Ring>> rings;
+
+  {
+    std::lock_guard<std::mutex> lock(g_ringsLock);
+    rings = g_rings;
+    rings.insert(rings.end(), g_retiredRings.begin(), g_retiredRings.end());
+  }
+
+  std::vector<Snapshot> snapshots;
+
+  for (auto const& ring : rings) {
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    uint64_t first = head > kRingSize ? head - kRingSize : 0;
+
+    for (uint64_t i = first; i < head; i++) {
+      const Record& record = ring->records[i % kRingSize];
+      Snapshot snapshot;
+      snapshot.time = record.words[0].load(std::memory_order_relaxed);
+      snapshot.thread = ring->thread;
+      snapshot.tag = record.words[1].load(std::memory_order_relaxed);
+      snapshot.arg0 =
+        static_cast<int64_t>(record.words[2].load(std::memory_order_relaxed));
+      snapshot.arg1 =
+        static_cast<int64_t>(record.words[3].load(std::memory_order_relaxed));
+      snapshots.push_back(snapshot);
+    }
+  }
+
+  std::sort(snapshots.begin(), snapshots.end(),
+            [](const Snapshot& a, const Snapshot& b) {
+              return a.time < b.time;
+            });
+
+  char line[256];
+
+  for (auto const& snapshot : snapshots) {
+    unsigned level = (snapshot.tag >> 16) & 0x3;
+    unsigned event = snapshot.tag & 0xffff;
+    int prefix = snprintf(line, sizeof(line), "%llu.%06llu [%s] t%llu ",
+      static_cast<unsigned long long>(snapshot.time / 1000000000ULL),
+      static_cast<unsigned long long>((snapshot.time / 1000) % 1000000ULL),
+      kLevelNames[level], static_cast<unsigned long long>(snapshot.thread));
+
+    if (IsCommandEvent(event)) {
+      snprintf(line + prefix, sizeof(line) - prefix, EventFormat(event),
+        CommandName(static_cast<uint32_t>(snapshot.arg0)).c_str(),
+        static_cast<long long>(snapshot.arg1));
+    } else {
+      snprintf(line + prefix, sizeof(line) - prefix, EventFormat(event),
+        static_cast<long long>(snapshot.arg0),
+        static_cast<long long>(snapshot.arg1));
+    }
+
+    lines.push_back(line);
+  }
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_TRACE_H_
+#define IOTIVITY_IOTIVITY_TRACE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Structured tracing for the hot paths.
+//
+// A trace point records an event id and two integer arguments into a per
+// thread binary ring; nothing is formatted until the rings are dumped.
+// Trace points above IOTIVITY_TRACE_LEVEL are compiled out, the others cost
+// one relaxed load while tracing is disabled at runtime (IOTIVITY_TRACE=1
+// or the setTrace sync command enable it). Release builds compile every
+// trace point out, the Makefile raises the level when RELEASE=false.
+#define IOTIVITY_TRACE_OFF 0
+#define IOTIVITY_TRACE_ERROR 1
+#define IOTIVITY_TRACE_INFO 2
+#define IOTIVITY_TRACE_DEBUG 3
+
+#ifndef IOTIVITY_TRACE_LEVEL
+#define IOTIVITY_TRACE_LEVEL IOTIVITY_TRACE_OFF
+#endif
+
+enum TraceEvent {
+  TRACE_MESSAGE_IN,
+  TRACE_MESSAGE_OUT,
+  TRACE_MESSAGE_INVALID,
+  TRACE_COMMAND_START,
+  TRACE_COMMAND_END,
+  TRACE_COMMAND_UNKNOWN,
+  TRACE_COMMAND_REJECTED,
+  TRACE_REPRESENTATION_IN,
+  TRACE_REPRESENTATION_OUT,
+  TRACE_REPRESENTATION_UPDATE,
+  TRACE_RESOURCE_FOUND,
+  TRACE_REQUEST,
+  TRACE_EVENT_COUNT
+};
+
+extern std::atomic<bool> g_traceEnabled;
+
+void TraceRecord(int level, TraceEvent event, int64_t arg0, int64_t arg1);
+void TraceSetEnabled(bool enabled);
+// Formats the records of every thread, oldest first
+void TraceDump(std::vector<std::string>& lines);
+
+#define IOTIVITY_TRACE(level, event, arg0, arg1)                         \
+  do {                                                                   \
+    if ((level) <= IOTIVITY_TRACE_LEVEL &&                               \
+        g_traceEnabled.load(std::memory_order_relaxed)) {                \
+      TraceRecord((level), (event), static_cast<int64_t>(arg0),          \
+                  static_cast<int64_t>(arg1));                           \
+    }                                                                    \
+  } while (0)
+
+#endif  // IOTIVITY_IOTIVITY_TRACE_H_
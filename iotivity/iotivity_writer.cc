@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "iotivity/iotivity_writer.h"
+
+#include <math.h>
+#include <cmath>
+#include <iterator>
+
+#include "iotivity/iotivity_cbor.h"
+
+namespace {
+
+const unsigned kMaxDepth = 64;
+
+// Reused between messages so steady state traffic does not allocate
+thread_local std::string t_buffer;
+thread_local std::string t_envelope;
+
+}  // namespace
+
+IotivityMessageWriter::IotivityMessageWriter(bool cbor)
+  : m_cbor(cbor), m_buffer(t_buffer), m_items(0), m_depth(0),
+    m_afterKey(false) {
+  m_buffer.clear();
+}
+
+IotivityMessageWriter::IotivityMessageWriter(bool cbor, std::string& buffer)
+  : m_cbor(cbor), m_buffer(buffer), m_items(0), m_depth(0),
+    m_afterKey(false) {
+  m_buffer.clear();
+}
+
+IotivityMessageWriter::~IotivityMessageWriter() {}
+
+void IotivityMessageWriter::separator() {
+  if (m_afterKey) {
+    m_afterKey = false;
+    return;
+  }
+
+  if (m_depth == 0) {
+    return;
+  }
+
+  bool hasItem;
+  if (m_depth <= kMaxDepth) {
+    uint64_t bit = 1ULL << (m_depth - 1);
+    hasItem = m_items & bit;
+    m_items |= bit;
+  } else {
+    size_t deep = m_depth - kMaxDepth - 1;
+    hasItem = m_deepItems[deep];
+    m_deepItems[deep] = true;
+  }
+
+  if (!m_cbor && hasItem) {
+    m_buffer.push_back(',');
+  }
+}
+
+void IotivityMessageWriter::open(char json, uint8_t cbor) {
+  separator();
+  m_buffer.push_back(m_cbor ? static_cast<char>(cbor) : json);
+  m_depth++;
+  if (m_depth <= kMaxDepth) {
+    m_items &= ~(1ULL << (m_depth - 1));
+  } else {
+    m_deepItems.resize(m_depth - kMaxDepth);
+    m_deepItems.back() = false;
+  }
+}
+
+void IotivityMessageWriter::close(char json) {
+  m_buffer.push_back(m_cbor ? static_cast<char>(0xff) : json);
+  m_depth--;
+}
+
+void IotivityMessageWriter::beginObject() { open('{', 0xbf); }
+
+void IotivityMessageWriter::endObject() { close('}'); }
+
+void IotivityMessageWriter::beginArray() { open('[', 0x9f); }
+
+void IotivityMessageWriter::endArray() { close(']'); }
+
+void IotivityMessageWriter::key(const std::string& name) {
+  separator();
+
+  if (m_cbor) {
+    CborWriteHead(m_buffer, 3, name.size());
+    m_buffer.append(name);
+  } else {
+    picojson::serialize_str(name, std::back_inserter(m_buffer));
+    m_buffer.push_back(':');
+  }
+
+  m_afterKey = true;
+}
+
+void IotivityMessageWriter::value(const std::string& str) {
+  separator();
+
+  if (m_cbor) {
+    CborWriteHead(m_buffer, 3, str.size());
+    m_buffer.append(str);
+  } else {
+    picojson::serialize_str(str, std::back_inserter(m_buffer));
+  }
+}
+
+void IotivityMessageWriter::value(const char* str) {
+  value(std::string(str));
+}
+
+void IotivityMessageWriter::value(double number) {
+  // JSON has no NaN or infinity
+  if (!std::isfinite(number)) {
+    nullValue();
+    return;
+  }
+
+  separator();
+
+  if (m_cbor) {
+    CborWriteNumber(m_buffer, number);
+    return;
+  }
+
+  // Same formatting as picojson::value::to_str()
+  char buf[256];
+  double tmp;
+  snprintf(buf, sizeof(buf),
+           fabs(number) < (1ULL << 53) && modf(number, &tmp) == 0 ?
+           "%.f" : "%.17g", number);
+  m_buffer.append(buf);
+}
+
+void IotivityMessageWriter::value(bool boolean) {
+  separator();
+
+  if (m_cbor) {
+    m_buffer.push_back(static_cast<char>(boolean ? 0xf5 : 0xf4));
+  } else {
+    m_buffer.append(boolean ? "true" : "false");
+  }
+}
+
+void IotivityMessageWriter::nullValue() {
+  separator();
+
+  if (m_cbor) {
+    m_buffer.push_back(static_cast<char>(0xf6));
+  } else {
+    m_buffer.append("null");
+  }
+}
+
+void IotivityMessageWriter::stringArray(
+  const std::vector<std::string>& strings) {
+  beginArray();
+  for (auto const& str : strings) {
+    value(str);
+  }
+  endArray();
+}
+
+void IotivityMessageWriter::stringArray(
+  const std::vector<IotivityAtom>& atoms) {
+  beginArray();
+  for (auto const& atom : atoms) {
+    value(atom.str());
+  }
+  endArray();
+}
+
+// Containers are indefinite-length in CBOR, so fragments splice as is
+void IotivityMessageWriter::raw(const std::string& encoded) {
+  separator();
+  m_buffer.append(encoded);
+}
+
+// Same mapping as TranslateOCRepresentationToPicojson
+void IotivityMessageWriter::representation(const OCRepresentation& oCRepr) {
+  beginObject();
+  key("uri");
+  value(oCRepr.getUri());
+
+  for (auto& cur : oCRepr) {
+    const std::string& attrname = cur.attrname();
+
+    if (AttributeType::String == cur.type()) {
+      key(attrname);
+      value(cur.getValue<string>());
+    } else if (AttributeType::Integer == cur.type()) {
+      key(attrname);
+      value(static_cast<double>(cur.getValue<int>()));
+    } else if (AttributeType::Double == cur.type()) {
+      key(attrname);
+      value(cur.getValue<double>());
+    } else if (AttributeType::Boolean == cur.type()) {
+      key(attrname);
+      value(cur.getValue<bool>());
+    } else if (AttributeType::OCRepresentation == cur.type()) {
+      key(attrname);
+      representation(cur.getValue<OCRepresentation>());
+    } else if (AttributeType::Vector == cur.type()) {
+      key(attrname);
+      beginArray();
+
+      if (cur.base_type() == AttributeType::OCRepresentation) {
+        for (auto const& item :
+             cur.getValue<std::vector<OCRepresentation>>()) {
+          representation(item);
+        }
+      } else if (cur.base_type() == AttributeType::String) {
+        for (auto const& item : cur.getValue<std::vector<std::string>>()) {
+          value(item);
+        }
+      } else if (cur.base_type() == AttributeType::Boolean) {
+        for (auto const item : cur.getValue<std::vector<bool>>()) {
+          value(static_cast<bool>(item));
+        }
+      } else if (cur.base_type() == AttributeType::Double) {
+        for (auto const item : cur.getValue<std::vector<double>>()) {
+          value(item);
+        }
+      } else if (cur.base_type() == AttributeType::Integer) {
+        for (auto const item : cur.getValue<std::vector<int>>()) {
+          value(static_cast<double>(item));
+        }
+      }
+
+      endArray();
+    }
+  }
+
+  endObject();
+}
+
+const std::string& IotivityMessageWriter::message() {
+  if (!m_cbor) {
+    return m_buffer;
+  }
+
+  t_envelope.assign(kCborMessagePrefix);
+  Base64Encode(m_buffer, t_envelope);
+  return t_envelope;
+}
+
+std::string& IotivityMessageWriter::payload() { return m_buffer; }
+
+bool IotivityMessageWriter::isCbor() { return m_cbor; }
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef IOTIVITY_IOTIVITY_WRITER_H_
+#define IOTIVITY_IOTIVITY_WRITER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "iotivity/iotivity_atom.h"
+#include "iotivity/iotivity_tools.h"
+
+// Streams an outbound message straight into a per-thread buffer, either as
+// JSON text or as a CBOR envelope, without building a picojson tree first.
+class IotivityMessageWriter {
+ private:
+  bool m_cbor;
+  std::string& m_buffer;
+  // Bit N set when the container at depth N already holds an item
+  uint64_t m_items;
+  // The same for containers nested deeper than the bits of m_items
+  std::vector<bool> m_deepItems;
+  unsigned m_depth;
+  bool m_afterKey;
+
+  void separator();
+  void open(char json, uint8_t cbor);
+  void close(char json);
+
+ public:
+  explicit IotivityMessageWriter(bool cbor);
+  // Encodes a fragment into buffer, to be spliced in later with raw()
+  IotivityMessageWriter(bool cbor, std::string& buffer);
+  ~IotivityMessageWriter();
+
+  void beginObject();
+  void endObject();
+  void beginArray();
+  void endArray();
+  void key(const std::string& name);
+
+  void value(const std::string& str);
+  void value(const char* str);
+  void value(double number);
+  void value(bool boolean);
+  void nullValue();
+
+  void representation(const OCRepresentation& oCRepr);
+  void stringArray(const std::vector<std::string>& strings);
+  void stringArray(const std::vector<IotivityAtom>& atoms);
+  // A complete value encoded earlier in the same format
+  void raw(const std::string& encoded);
+
+  // Finished message, valid until the next writer runs on this thread
+  const std::string& message();
+  // JSON text or raw CBOR, without the CBOR envelope
+  std::string& payload();
+  bool isCbor();
+};
+
+#endif  // IOTIVITY_IOTIVITY_WRITER_H_
@@ -0,0 +1,815 @@
+/*
+ * Copyright (c) 2015 Cisco and/or its affiliates. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Cisco nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+// Offline benchmark for the IoTivity extension.
+//
+// Loads libiotivity-extension.so the way Crosswalk does, plays the part of
+// the runtime and of the JS API (including the server side answering
+// entityHandler requests) and reports throughput and latency percentiles
+// for scripted workloads. The IoTivity stack runs in-process with both
+// roles, so the resource workloads only use the loopback interface.
+// "commands" times the command lookup alone, the former if/else chain of
+// string compares against the dispatcher. "serialize" times an outbound
+// reply built as a picojson tree against IotivityMessageWriter. Commands
+// are sent with "cmd" first like the JS API does, "update-cmdlast" sends
+// it after the payload, which the parser then reads twice.
+//
+// usage: iotivity_bench [-l library] [-n requests] [-c concurrency]
+//                       [-r resources] [workload...]
+// workloads: sync commands serialize dispatch retrieve update
+//            update-cmdlast observe discover
+//            (default: all but discover)
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/XW_Extension.h"
+#include "common/XW_Extension_SyncMessage.h"
+#include "common/picojson.h"
+#include "iotivity/iotivity_cbor.h"
+#include "iotivity/iotivity_dispatcher.h"
+#include "iotivity/iotivity_writer.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const XW_Extension kExtension = 1;
+const XW_Instance kInstance = 1;
+// Ids used by the host itself when answering requests, never measured
+const double kResponseCallIdBase = 1e9;
+const int kReplyTimeoutSec = 10;
+const size_t kDiscoverRounds = 10;
+
+// In the order of the if/else chain HandleMessage had before the dispatcher
+const char* const kCommands[] = {
+  "configure", "factoryReset", "reboot", "findResources", "findDevices",
+  "createResource", "retrieveResource", "updateResource", "deleteResource",
+  "startObserving", "cancelObserving", "registerResource",
+  "unregisterResource", "enablePresence", "disablePresence", "notify",
+  "sendResponse", "sendError"
+};
+const size_t kCommandCount = sizeof(kCommands) / sizeof(kCommands[0]);
+
+XW_CreatedInstanceCallback g_instanceCreated = NULL;
+XW_DestroyedInstanceCallback g_instanceDestroyed = NULL;
+XW_ShutdownCallback g_shutdown = NULL;
+XW_HandleMessageCallback g_handleMessage = NULL;
+XW_HandleSyncMessageCallback g_handleSyncMessage = NULL;
+void* g_instanceData = NULL;
+std::string g_syncReply;
+
+// Off for the baseline variants, picojson then sorts "cmd" among the keys
+bool g_cmdFirst = true;
+
+std::mutex g_lock;
+std::condition_variable g_cond;
+double g_nextCallId = 1;
+double g_nextResponseId = kResponseCallIdBase;
+struct Pending {
+  Clock::time_point sent;
+  // Set up and control commands are left out of the reports
+  bool measured;
+};
+
+std::map<double, Pending> g_pending;
+std::map<double, picojson::value> g_replies;
+std::vector<double> g_latenciesUs;
+std::deque<Clock::time_point> g_notifications;
+size_t g_entityRequests = 0;
+
+void SetExtensionName(XW_Extension, const char* name) {
+  printf("extension: %s\n", name);
+}
+
+void SetJavaScriptAPI(XW_Extension, const char*) {}
+
+void RegisterInstanceCallbacks(XW_Extension,
+                               XW_CreatedInstanceCallback created,
+                               XW_DestroyedInstanceCallback destroyed) {
+  g_instanceCreated = created;
+  g_instanceDestroyed = destroyed;
+}
+
+void RegisterShutdownCallback(XW_Extension, XW_ShutdownCallback shutdown) {
+  g_shutdown = shutdown;
+}
+
+void SetInstanceData(XW_Instance, void* data) { g_instanceData = data; }
+
+void* GetInstanceData(XW_Instance) { return g_instanceData; }
+
+void RegisterMessage(XW_Extension, XW_HandleMessageCallback handler) {
+  g_handleMessage = handler;
+}
+
+void RegisterSyncMessage(XW_Extension, XW_HandleSyncMessageCallback handler) {
+  g_handleSyncMessage = handler;
+}
+
+void SetSyncReply(XW_Instance, const char* reply) { g_syncReply = reply; }
+
+void Post(picojson::object& msg);
+
+// What the JS API would do with a native message, g_lock held
+void Deliver(const picojson::value& msg, Clock::time_point received) {
+  if (!msg.is<picojson::object>()) return;
+
+  std::string cmd = msg.get("cmd").to_str();
+
+  if (cmd == "eventBatch") {
+    const picojson::array& events = msg.get("events").get<picojson::array>();
+    for (size_t i = 0; i < events.size(); i++) {
+      Deliver(events[i], received);
+    }
+    return;
+  }
+
+  if (cmd == "entityHandler") {
+    // Answer like a JS server would, straight from the request event
+    picojson::object event =
+      msg.get("OicRequestEvent").get<picojson::object>();
+    if (event.find("properties") == event.end()) {
+      event["properties"] = picojson::value(picojson::object());
+    }
+
+    picojson::object response;
+    response["cmd"] = picojson::value("sendResponse");
+    response["asyncCallId"] = picojson::value(g_nextResponseId++);
+    response["OicRequestEvent"] = picojson::value(event);
+    g_entityRequests++;
+    Post(response);
+    return;
+  }
+
+  if (cmd == "onObserve" && msg.get("type").to_str() == "update") {
+    if (!g_notifications.empty()) {
+      g_latenciesUs.push_back(std::chrono::duration<double, std::micro>(
+        received - g_notifications.front()).count());
+      g_notifications.pop_front();
+      g_cond.notify_all();
+    }
+    return;
+  }
+
+  if (!msg.get("asyncCallId").is<double>()) return;
+
+  auto it = g_pending.find(msg.get("asyncCallId").get<double>());
+  if (it == g_pending.end()) return;
+
+  if (it->second.measured) {
+    g_latenciesUs.push_back(std::chrono::duration<double, std::micro>(
+      received - it->second.sent).count());
+  }
+  g_replies[it->first] = msg;
+  g_pending.erase(it);
+  g_cond.notify_all();
+}
+
+void PostMessage(XW_Instance, const char* message) {
+  Clock::time_point received = Clock::now();
+  picojson::value msg;
+  std::string error;
+
+  picojson::parse(msg, message, message + strlen(message), &error);
+
+  if (!error.empty()) {
+    fprintf(stderr, "unparsable message from the extension: %s\n",
+            error.c_str());
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(g_lock);
+  Deliver(msg, received);
+}
+
+const XW_CoreInterface kCoreInterface = {
+  SetExtensionName, SetJavaScriptAPI, RegisterInstanceCallbacks,
+  RegisterShutdownCallback, SetInstanceData, GetInstanceData
+};
+
+const XW_MessagingInterface kMessagingInterface = {
+  RegisterMessage, PostMessage
+};
+
+const XW_Internal_SyncMessagingInterface kSyncMessagingInterface = {
+  RegisterSyncMessage, SetSyncReply
+};
+
+const void* GetInterface(const char* name) {
+  if (!strcmp(name, XW_CORE_INTERFACE)) return &kCoreInterface;
+  if (!strcmp(name, XW_MESSAGING_INTERFACE)) return &kMessagingInterface;
+  if (!strcmp(name, XW_INTERNAL_SYNC_MESSAGING_INTERFACE))
+    return &kSyncMessagingInterface;
+  return NULL;
+}
+
+std::string Serialize(const picojson::object& msg) {
+  picojson::object::const_iterator cmd = msg.find("cmd");
+
+  if (!g_cmdFirst || cmd == msg.end()) {
+    return picojson::value(msg).serialize();
+  }
+
+  std::string text = "{\"cmd\":" + cmd->second.serialize();
+  for (auto const& item : msg) {
+    if (item.first == "cmd") continue;
+    text += "," + picojson::value(item.first).serialize() + ":" +
+            item.second.serialize();
+  }
+  return text + "}";
+}
+
+// Extension callbacks may post synchronously, so g_lock is released here
+void Post(picojson::object& msg) {
+  std::string text = Serialize(msg);
+  g_lock.unlock();
+  g_handleMessage(kInstance, text.c_str());
+  g_lock.lock();
+}
+
+// Posts a command, g_lock held
+double Send(picojson::object& msg, bool measured) {
+  double id = g_nextCallId++;
+  msg["asyncCallId"] = picojson::value(id);
+  g_pending[id].sent = Clock::now();
+  g_pending[id].measured = measured;
+  Post(msg);
+  return id;
+}
+
+picojson::value Call(picojson::object msg) {
+  std::unique_lock<std::mutex> lock(g_lock);
+  double id = Send(msg, false);
+
+  if (!g_cond.wait_for(lock, std::chrono::seconds(kReplyTimeoutSec),
+                       [id]() { return g_replies.count(id) != 0; })) {
+    fprintf(stderr, "%s: no reply\n", msg["cmd"].to_str().c_str());
+    exit(1);
+  }
+
+  picojson::value reply = g_replies[id];
+  g_replies.erase(id);
+
+  if (reply.get("cmd").to_str() == "asyncCallError") {
+    fprintf(stderr, "%s failed\n", msg["cmd"].to_str().c_str());
+    exit(1);
+  }
+
+  return reply;
+}
+
+double Percentile(const std::vector<double>& sorted, double fraction) {
+  size_t rank = static_cast<size_t>(sorted.size() * fraction);
+  return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void Report(const char* name, double elapsedSec) {
+  std::vector<double> sorted;
+  {
+    std::lock_guard<std::mutex> lock(g_lock);
+    sorted.swap(g_latenciesUs);
+  }
+
+  if (sorted.empty()) {
+    printf("%-18s no completed requests\n", name);
+    return;
+  }
+
+  std::sort(sorted.begin(), sorted.end());
+  printf("%-18s %8zu req %10.0f req/s  p50 %8.1f us  p99 %8.1f us  "
+         "max %8.1f us\n", name, sorted.size(), sorted.size() / elapsedSec,
+         Percentile(sorted, 0.5), Percentile(sorted, 0.99), sorted.back());
+}
+
+// Keeps up to 'concurrency' commands in flight until 'count' completed
+void RunAsync(const char* name, size_t count, size_t concurrency,
+              const std::function<picojson::object(size_t)>& make) {
+  Clock::time_point start = Clock::now();
+  std::unique_lock<std::mutex> lock(g_lock);
+
+  for (size_t i = 0; i < count; i++) {
+    g_cond.wait(lock, [concurrency]() {
+      return g_pending.size() < concurrency;
+    });
+    picojson::object msg = make(i);
+    Send(msg, true);
+  }
+
+  if (!g_cond.wait_for(lock, std::chrono::seconds(kReplyTimeoutSec),
+                       []() { return g_pending.empty(); })) {
+    fprintf(stderr, "%s: %zu requests unanswered\n", name, g_pending.size());
+    g_pending.clear();
+  }
+
+  g_replies.clear();
+  lock.unlock();
+
+  Report(name, std::chrono::duration<double>(Clock::now() - start).count());
+}
+
+// For in-process loops, where the time per operation is what matters
+void ReportLoop(const char* name, size_t count, Clock::time_point start) {
+  double elapsedSec =
+    std::chrono::duration<double>(Clock::now() - start).count();
+  printf("%-18s %8zu ops %10.0f ops/s  %8.1f ns/op\n", name, count,
+         count / elapsedSec, elapsedSec * 1e9 / count);
+}
+
+void RunCommands(size_t count) {
+  std::vector<picojson::value> messages(kCommandCount);
+  std::vector<IotivityDispatcher::Handler> handlers;
+  IotivityDispatcher dispatcher;
+  size_t handled = 0;
+
+  for (size_t i = 0; i < kCommandCount; i++) {
+    picojson::object msg;
+    msg["cmd"] = picojson::value(kCommands[i]);
+    msg["asyncCallId"] = picojson::value(static_cast<double>(i));
+    messages[i] = picojson::value(msg);
+
+    handlers.push_back([&handled](const picojson::value&) { handled++; });
+    dispatcher.registerHandler(CommandHash(kCommands[i]), handlers.back());
+  }
+
+  Clock::time_point start = Clock::now();
+
+  for (size_t i = 0; i < count; i++) {
+    const picojson::value& msg = messages[i % kCommandCount];
+    const std::string& cmd = msg.get("cmd").get<std::string>();
+
+    for (size_t c = 0; c < kCommandCount; c++) {
+      if (cmd == kCommands[c]) {
+        handlers[c](msg);
+        break;
+      }
+    }
+  }
+
+  ReportLoop("commands/chain", count, start);
+  start = Clock::now();
+
+  for (size_t i = 0; i < count; i++) {
+    const picojson::value& msg = messages[i % kCommandCount];
+    dispatcher.dispatch(CommandHash(msg.get("cmd").get<std::string>()), msg);
+  }
+
+  ReportLoop("commands/hash", count, start);
+
+  if (handled != 2 * count) {
+    fprintf(stderr, "commands: %zu of %zu dispatched\n", handled, 2 * count);
+  }
+}
+
+const char* const kModes[] = {"eco", "comfort", "boost"};
+const size_t kModeCount = sizeof(kModes) / sizeof(kModes[0]);
+
+// A retrieveResourceCompleted reply, the way the extension used to build it
+std::string SerializeTree(size_t i, bool cbor) {
+  picojson::array modes;
+  for (size_t m = 0; m < kModeCount; m++) {
+    modes.push_back(picojson::value(kModes[m]));
+  }
+
+  picojson::object properties;
+  properties["value"] = picojson::value(static_cast<double>(i));
+  properties["level"] = picojson::value(i * 0.5);
+  properties["state"] = picojson::value(i % 2 == 0);
+  properties["name"] = picojson::value("bench");
+  properties["modes"] = picojson::value(modes);
+
+  picojson::array types;
+  types.push_back(picojson::value("oic.r.bench"));
+  picojson::array interfaces;
+  interfaces.push_back(picojson::value("oic.if.baseline"));
+
+  picojson::object resource;
+  resource["id"] = picojson::value("coap://127.0.0.1:5683/bench/resource");
+  resource["url"] = picojson::value("/bench/resource");
+  resource["deviceId"] = picojson::value("bench-device");
+  resource["resourceTypes"] = picojson::value(types);
+  resource["interfaces"] = picojson::value(interfaces);
+  resource["properties"] = picojson::value(properties);
+
+  picojson::object msg;
+  msg["cmd"] = picojson::value("retrieveResourceCompleted");
+  msg["asyncCallId"] = picojson::value(static_cast<double>(i));
+  msg["OicResource"] = picojson::value(resource);
+
+  std::string text;
+  if (cbor) {
+    EncodeCborMessage(picojson::value(msg), text);
+  } else {
+    text = picojson::value(msg).serialize();
+  }
+  return text;
+}
+
+// The same reply streamed by the writer
+std::string SerializeWriter(size_t i, bool cbor) {
+  IotivityMessageWriter writer(cbor);
+  writer.beginObject();
+  writer.key("cmd");
+  writer.value("retrieveResourceCompleted");
+  writer.key("asyncCallId");
+  writer.value(static_cast<double>(i));
+  writer.key("OicResource");
+  writer.beginObject();
+  writer.key("id");
+  writer.value("coap://127.0.0.1:5683/bench/resource");
+  writer.key("url");
+  writer.value("/bench/resource");
+  writer.key("deviceId");
+  writer.value("bench-device");
+  writer.key("resourceTypes");
+  writer.stringArray(std::vector<std::string>(1, "oic.r.bench"));
+  writer.key("interfaces");
+  writer.stringArray(std::vector<std::string>(1, "oic.if.baseline"));
+  writer.key("properties");
+  writer.beginObject();
+  writer.key("value");
+  writer.value(static_cast<double>(i));
+  writer.key("level");
+  writer.value(i * 0.5);
+  writer.key("state");
+  writer.value(i % 2 == 0);
+  writer.key("name");
+  writer.value("bench");
+  writer.key("modes");
+  writer.beginArray();
+  for (size_t m = 0; m < kModeCount; m++) {
+    writer.value(kModes[m]);
+  }
+  writer.endArray();
+  writer.endObject();
+  writer.endObject();
+  writer.endObject();
+  return writer.message();
+}
+
+void RunSerialize(size_t count) {
+  const struct {
+    const char* name;
+    std::function<std::string(size_t, bool)> serialize;
+    bool cbor;
+  } variants[] = {
+    {"serialize/picojson", SerializeTree, false},
+    {"serialize/writer", SerializeWriter, false},
+    {"cbor/picojson", SerializeTree, true},
+    {"cbor/writer", SerializeWriter, true},
+  };
+
+  for (auto const& variant : variants) {
+    size_t bytes = 0;
+    Clock::time_point start = Clock::now();
+
+    for (size_t i = 0; i < count; i++) {
+      bytes += variant.serialize(i, variant.cbor).size();
+    }
+
+    ReportLoop(variant.name, count, start);
+    printf("%-18s %8.1f bytes/message\n", "",
+           static_cast<double>(bytes) / count);
+  }
+}
+
+void RunSync(size_t count) {
+  Clock::time_point start = Clock::now();
+  std::string msg = "{\"cmd\":\"getStats\"}";
+
+  for (size_t i = 0; i < count; i++) {
+    Clock::time_point sent = Clock::now();
+    g_handleSyncMessage(kInstance, msg.c_str());
+    std::lock_guard<std::mutex> lock(g_lock);
+    g_latenciesUs.push_back(std::chrono::duration<double, std::micro>(
+      Clock::now() - sent).count());
+  }
+
+  Report("sync", std::chrono::duration<double>(Clock::now() - start).count());
+}
+
+void RunObserve(const picojson::object& resource,
+                const std::string& serverId, size_t count) {
+  picojson::object observe;
+  observe["cmd"] = picojson::value("startObserving");
+  observe["id"] = resource.at("id");
+  Call(observe);
+
+  Clock::time_point start = Clock::now();
+
+  for (size_t i = 0; i < count; i++) {
+    picojson::array names;
+    names.push_back(picojson::value("value"));
+
+    picojson::object notify;
+    notify["cmd"] = picojson::value("notify");
+    notify["resourceId"] = picojson::value(serverId);
+    notify["method"] = picojson::value("update");
+    notify["updatedPropertyNames"] = picojson::value(names);
+
+    std::unique_lock<std::mutex> lock(g_lock);
+    g_notifications.push_back(Clock::now());
+    double id = Send(notify, false);
+    if (!g_cond.wait_for(lock, std::chrono::seconds(kReplyTimeoutSec),
+                         []() { return g_notifications.empty(); })) {
+      fprintf(stderr, "observe: notification lost\n");
+      g_notifications.clear();
+    }
+    g_cond.wait(lock, [id]() { return g_replies.count(id) != 0; });
+    g_replies.erase(id);
+  }
+
+  Report("observe",
+         std::chrono::duration<double>(Clock::now() - start).count());
+
+  picojson::object cancel;
+  cancel["cmd"] = picojson::value("cancelObserving");
+  cancel["id"] = resource.at("id");
+  Call(cancel);
+}
+
+picojson::object MakeResourceInit(const std::string& url,
+                                  const std::string& type) {
+  picojson::array types;
+  types.push_back(picojson::value(type));
+  picojson::array interfaces;
+  interfaces.push_back(picojson::value("oic.if.baseline"));
+
+  picojson::object init;
+  init["url"] = picojson::value(url);
+  init["deviceId"] = picojson::value("");
+  init["connectionMode"] = picojson::value("acked");
+  init["discoverable"] = picojson::value(true);
+  init["observable"] = picojson::value(true);
+  init["resourceTypes"] = picojson::value(types);
+  init["interfaces"] = picojson::value(interfaces);
+  return init;
+}
+
+void Configure() {
+  static bool configured = false;
+  if (configured) return;
+
+  picojson::object settings;
+  settings["role"] = picojson::value("intermediate");
+  settings["connectionMode"] = picojson::value("acked");
+
+  picojson::object configure;
+  configure["cmd"] = picojson::value("configure");
+  configure["settings"] = picojson::value(settings);
+  Call(configure);
+  configured = true;
+}
+
+std::string Register(const std::string& url, const std::string& type) {
+  picojson::object registration;
+  registration["cmd"] = picojson::value("registerResource");
+  registration["OicResourceInit"] =
+    picojson::value(MakeResourceInit(url, type));
+  return Call(registration).get("id").to_str();
+}
+
+// Registers the benchmark resource and discovers it through the client
+bool SetUpResource(picojson::object& found, std::string& serverId) {
+  Configure();
+  serverId = Register("/bench/resource", "oic.r.bench");
+
+  picojson::object options;
+  options["resourceType"] = picojson::value("oic.r.bench");
+  options["waitsec"] = picojson::value(1.0);
+
+  picojson::object find;
+  find["cmd"] = picojson::value("findResources");
+  find["OicDiscoveryOptions"] = picojson::value(options);
+  picojson::value reply = Call(find);
+
+  if (!reply.get("resourcesArray").is<picojson::array>()) return false;
+
+  const picojson::array& resources =
+    reply.get("resourcesArray").get<picojson::array>();
+
+  // Same shape as the OicResource the JS API passes back
+  for (size_t i = 0; i < resources.size(); i++) {
+    const picojson::value& init = resources[i].get("OicResourceInit");
+    if (init.is<picojson::object>() &&
+        init.get("url").to_str() == "/bench/resource") {
+      found = init.get<picojson::object>();
+      found["id"] = resources[i].get("id");
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Registers 'resources' resources, then reports what a discovery of all of
+// them costs once its window closed: building and delivering the result
+void RunDiscover(size_t resources) {
+  Configure();
+  for (size_t i = 0; i < resources; i++) {
+    Register("/bench/discover/" + std::to_string(i), "oic.r.bench.discover");
+  }
+
+  picojson::object options;
+  options["resourceType"] = picojson::value("oic.r.bench.discover");
+  options["waitsec"] = picojson::value(5.0);
+  options["adaptive"] = picojson::value(true);
+  options["minWaitMs"] = picojson::value(100.0);
+  options["maxAge"] = picojson::value(0.0);
+
+  picojson::object find;
+  find["cmd"] = picojson::value("findResources");
+  find["OicDiscoveryOptions"] = picojson::value(options);
+
+  Clock::time_point start = Clock::now();
+  size_t found = 0;
+
+  for (size_t round = 0; round < kDiscoverRounds; round++) {
+    Clock::time_point sent = Clock::now();
+    picojson::value reply = Call(find);
+    double elapsedUs = std::chrono::duration<double, std::micro>(
+      Clock::now() - sent).count();
+
+    if (reply.get("resourcesArray").is<picojson::array>()) {
+      found = reply.get("resourcesArray").get<picojson::array>().size();
+    }
+
+    std::lock_guard<std::mutex> lock(g_lock);
+    g_latenciesUs.push_back(
+      elapsedUs - reply.get("window").get<double>() * 1000);
+  }
+
+  printf("discover: %zu of %zu resources found per round\n", found,
+         resources);
+  Report("discover",
+         std::chrono::duration<double>(Clock::now() - start).count());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* library = "build/libiotivity-extension.so";
+  size_t count = 10000;
+  size_t concurrency = 16;
+  size_t resources = 1000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "l:n:c:r:")) != -1) {
+    switch (opt) {
+      case 'l': library = optarg; break;
+      case 'n': count = strtoul(optarg, NULL, 10); break;
+      case 'c': concurrency = strtoul(optarg, NULL, 10); break;
+      case 'r': resources = strtoul(optarg, NULL, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-l library] [-n requests] "
+                "[-c concurrency] [-r resources] [workload...]\n", argv[0]);
+        return 1;
+    }
+  }
+
+  if (concurrency == 0) concurrency = 1;
+
+  std::vector<std::string> workloads(argv + optind, argv + argc);
+  if (workloads.empty()) {
+    workloads = {"sync", "commands", "serialize", "dispatch", "retrieve",
+                 "update", "update-cmdlast", "observe"};
+  }
+
+  void* handle = dlopen(library, RTLD_NOW);
+  if (handle == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return 1;
+  }
+
+  XW_Initialize_Func initialize = reinterpret_cast<XW_Initialize_Func>(
+    dlsym(handle, "XW_Initialize"));
+  if (initialize == NULL || initialize(kExtension, GetInterface) != XW_OK ||
+      g_instanceCreated == NULL) {
+    fprintf(stderr, "cannot initialize %s\n", library);
+    return 1;
+  }
+
+  g_instanceCreated(kInstance);
+
+  picojson::object resource;
+  std::string serverId;
+  bool hasResource = false;
+
+  for (size_t w = 0; w < workloads.size(); w++) {
+    const std::string& name = workloads[w];
+
+    if (name == "sync") {
+      RunSync(count);
+      continue;
+    }
+
+    if (name == "commands") {
+      RunCommands(count);
+      continue;
+    }
+
+    if (name == "serialize") {
+      RunSerialize(count);
+      continue;
+    }
+
+    if (name == "discover") {
+      RunDiscover(resources);
+      continue;
+    }
+
+    if (name == "dispatch") {
+      RunAsync("dispatch", count, concurrency, [](size_t) {
+        picojson::object msg;
+        msg["cmd"] = picojson::value("getExecutorStats");
+        return msg;
+      });
+      continue;
+    }
+
+    if (name != "retrieve" && name != "update" &&
+        name != "update-cmdlast" && name != "observe") {
+      fprintf(stderr, "unknown workload %s\n", name.c_str());
+      continue;
+    }
+
+    if (!hasResource && !(hasResource = SetUpResource(resource, serverId))) {
+      fprintf(stderr, "benchmark resource not discovered on loopback\n");
+      return 1;
+    }
+
+    if (name == "retrieve") {
+      RunAsync("retrieve", count, concurrency, [&resource](size_t) {
+        picojson::object msg;
+        msg["cmd"] = picojson::value("retrieveResource");
+        msg["id"] = resource["id"];
+        return msg;
+      });
+    } else if (name == "update" || name == "update-cmdlast") {
+      g_cmdFirst = name == "update";
+      RunAsync(name.c_str(), count, concurrency, [&resource](size_t i) {
+        picojson::object properties;
+        properties["value"] = picojson::value(static_cast<double>(i));
+
+        picojson::object updated = resource;
+        updated["properties"] = picojson::value(properties);
+
+        picojson::object msg;
+        msg["cmd"] = picojson::value("updateResource");
+        msg["OicResource"] = picojson::value(updated);
+        msg["doPost"] = picojson::value(false);
+        return msg;
+      });
+      g_cmdFirst = true;
+    } else {
+      RunObserve(resource, serverId, count);
+    }
+  }
+
+  printf("entity requests answered: %zu\n", g_entityRequests);
+
+  g_instanceDestroyed(kInstance);
+  if (g_shutdown != NULL) g_shutdown(kExtension);
+  dlclose(handle);
+
+  return 0;
+}